@@ -0,0 +1,655 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	End-to-end benchmark of semidynamic_compact_index.
+
+	Usage: sdci_bench [--length N] [--queries Q] [--pages P] [--seed S] [--out FILE]
+
+	For each corpus (DNA, protein, byte log) and each parameter set
+	(sigma, q, k), this program measures
+	- append throughput, assign_parallel throughput with all hardware threads,
+	  and append_file throughput from a file of the text as bytes,
+	- locate/count latency percentiles for each pattern length,
+	- the memory and the locate latency with the compact directory of q-grams,
+	- extract/retrieve time,
+	- save_file/load_file bandwidth, and the time of map_file with the first query,
+	- the latency of a naive scan of the text for the same patterns,
+	- the latency of locate_approx with one error (Hamming and edit distances),
+	  against locating every variant of the pattern with one substitution,
+	- the latency of locate with a pattern of character classes
+	  against locating every expansion of the pattern,
+	- the throughput of query_executor for 1, 2, 4, ... threads,
+	and writes the results in JSON.
+	The exit status is 1 if a result disagrees with the naive scan or the original index.
+	All the indexes are allocated with the pages P of sdci::memory_options
+	(normal, transparent_huge, huge_2m or huge_1g) with prefaulting,
+	so that runs with different P show the effect of huge pages on the latencies.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "semidynamic_compact_index.h"
+#include "query_executor.h"
+
+namespace{
+	typedef std::size_t size_type;
+	typedef std::chrono::steady_clock clock_type;
+	typedef std::mt19937_64 random_engine;
+
+	struct bench_config{
+		const char *corpus;
+		size_type sigma;
+		size_type param_q;
+		size_type param_k;
+	};
+
+	const bench_config configs[] = {
+		{"dna", 4, 10, 2},
+		{"dna", 4, 12, 4},
+		{"dna", 4, 12, 8},
+		{"protein", 20, 4, 1},
+		{"protein", 20, 5, 2},
+		{"log", 256, 3, 1},
+		{"log", 256, 3, 2},
+	};
+
+	struct bench_options{
+		size_type text_length;
+		size_type num_queries;
+		size_type num_naive_queries;
+		unsigned long long seed;
+		std::string output;
+		std::string tmpfile;
+		std::string pages;
+	};
+
+	double seconds_since(clock_type::time_point start){
+		return std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+
+	// A random genome-like text: random segments mixed with mutated copies
+	// of earlier segments, so that long repeats occur.
+	void generate_dna(size_type n, random_engine &rng, std::vector<size_type> &text){
+		text.clear();
+		text.reserve(n);
+		std::uniform_int_distribution<size_type> ch(0, 3);
+		std::uniform_int_distribution<size_type> seglen(50, 2000);
+		std::uniform_real_distribution<double> unit(0.0, 1.0);
+		while(text.size() < n){
+			const size_type len = std::min(seglen(rng), n - text.size());
+			if(text.size() > 10000 && unit(rng) < 0.3){
+				const size_type from =
+					std::uniform_int_distribution<size_type>(0, text.size() - len - 1)(rng);
+				for(size_type i = 0; i < len; ++i){
+					text.push_back(unit(rng) < 0.02 ? ch(rng) : text[from + i]);
+				}
+			}
+			else{
+				for(size_type i = 0; i < len; ++i){
+					text.push_back(ch(rng));
+				}
+			}
+		}
+	}
+
+	// Amino acids drawn from their natural frequencies (in 0.1 %).
+	void generate_protein(size_type n, random_engine &rng, std::vector<size_type> &text){
+		static const double freq[20] = {
+			82, 55, 41, 54, 14, 39, 68, 71, 23, 59,
+			97, 58, 24, 39, 47, 66, 53, 11, 29, 69,
+		};
+		std::discrete_distribution<size_type> aa(freq, freq + 20);
+		text.resize(n);
+		for(size_type i = 0; i < n; ++i){
+			text[i] = aa(rng);
+		}
+	}
+
+	// Lines of a synthetic access log, one character per byte.
+	void generate_log(size_type n, random_engine &rng, std::vector<size_type> &text){
+		static const char *const levels[] = {"INFO", "INFO", "INFO", "WARN", "ERROR", "DEBUG"};
+		static const char *const paths[] = {
+			"/api/v1/search", "/api/v1/items", "/static/app.js", "/login", "/api/v2/stats",
+		};
+		static const int statuses[] = {200, 200, 200, 304, 404, 500};
+		text.clear();
+		text.reserve(n + 256);
+		char line[256];
+		size_type sec = 0;
+		while(text.size() < n){
+			sec += std::uniform_int_distribution<size_type>(0, 3)(rng);
+			const int len = std::snprintf(line, sizeof(line),
+				"2015-06-%02u %02u:%02u:%02u %s worker-%u GET %s id=%u status=%d time=%ums\n",
+				unsigned(sec / 86400 % 28 + 1), unsigned(sec / 3600 % 24),
+				unsigned(sec / 60 % 60), unsigned(sec % 60),
+				levels[rng() % 6], unsigned(rng() % 32), paths[rng() % 5],
+				unsigned(rng() % 1000000), statuses[rng() % 6], unsigned(rng() % 1000)
+			);
+			for(int i = 0; i < len; ++i){
+				text.push_back(static_cast<unsigned char>(line[i]));
+			}
+		}
+		text.resize(n);
+	}
+
+	void generate(const std::string &corpus, size_type n, random_engine &rng, std::vector<size_type> &text){
+		if(corpus == "dna"){
+			generate_dna(n, rng, text);
+		}
+		else if(corpus == "protein"){
+			generate_protein(n, rng, text);
+		}
+		else{
+			generate_log(n, rng, text);
+		}
+	}
+
+	size_type naive_count(const std::vector<size_type> &text, const std::vector<size_type> &pattern){
+		size_type cnt = 0;
+		std::vector<size_type>::const_iterator it = text.begin();
+		while(true){
+			it = std::search(it, text.end(), pattern.begin(), pattern.end());
+			if(it == text.end()){
+				break;
+			}
+			++cnt;
+			++it;
+		}
+		return cnt;
+	}
+
+	struct latency_summary{
+		double mean, p50, p90, p99, max;
+	};
+
+	latency_summary summarize(std::vector<double> &lat){
+		latency_summary s = {0, 0, 0, 0, 0};
+		if(lat.empty()){
+			return s;
+		}
+		std::sort(lat.begin(), lat.end());
+		double sum = 0;
+		for(size_type i = 0; i < lat.size(); ++i){
+			sum += lat[i];
+		}
+		s.mean = sum / lat.size();
+		s.p50 = lat[(lat.size() - 1) * 50 / 100];
+		s.p90 = lat[(lat.size() - 1) * 90 / 100];
+		s.p99 = lat[(lat.size() - 1) * 99 / 100];
+		s.max = lat.back();
+		return s;
+	}
+
+	void write_summary(std::ostream &out, const latency_summary &s){
+		out << "\"mean_us\": " << s.mean * 1e6
+		    << ", \"p50_us\": " << s.p50 * 1e6
+		    << ", \"p90_us\": " << s.p90 * 1e6
+		    << ", \"p99_us\": " << s.p99 * 1e6
+		    << ", \"max_us\": " << s.max * 1e6;
+	}
+
+	size_type file_size(const std::string &filename){
+		std::ifstream stream(filename.c_str(), std::ios_base::binary | std::ios_base::ate);
+		return stream.good() ? static_cast<size_type>(stream.tellg()) : 0;
+	}
+
+	// Returns the number of the results which disagree with the naive scan or the original index.
+	size_type run_config(std::ostream &out, const bench_config &cfg, const bench_options &opt){
+		random_engine rng(opt.seed);
+		std::vector<size_type> text;
+		generate(cfg.corpus, opt.text_length, rng, text);
+		for(size_type i = 0; i < text.size(); ++i){
+			text[i] %= cfg.sigma;
+		}
+
+		sdci::semidynamic_compact_index idx(cfg.sigma, cfg.param_q, cfg.param_k);
+
+		// append in blocks, as an ingest pipeline would
+		const size_type block = 1 << 16;
+		clock_type::time_point start = clock_type::now();
+		for(size_type i = 0; i < text.size(); i += block){
+			const size_type last = std::min(text.size(), i + block);
+			idx.append(text.begin() + i, text.begin() + last);
+		}
+		const double build_sec = seconds_since(start);
+
+		double parallel_sec = 0;
+		{
+			sdci::semidynamic_compact_index rebuilt(cfg.sigma, cfg.param_q, cfg.param_k);
+			start = clock_type::now();
+			rebuilt.assign_parallel(text.begin(), text.end());
+			parallel_sec = seconds_since(start);
+		}
+
+		// ingest of the same text stored as bytes in a file
+		double file_sec = 0;
+		size_type file_mismatches = 0;
+		if(cfg.sigma <= 256){
+			{
+				std::vector<char> bytes(text.begin(), text.end());
+				std::ofstream file(opt.tmpfile.c_str(), std::ios_base::binary);
+				file.write(bytes.data(), bytes.size());
+			}
+			std::vector<size_type> alphabet_map(256);
+			for(size_type c = 0; c < 256; ++c){
+				alphabet_map[c] = c;
+			}
+			sdci::semidynamic_compact_index ingested(cfg.sigma, cfg.param_q, cfg.param_k);
+			start = clock_type::now();
+			ingested.append_file(opt.tmpfile.c_str(), alphabet_map);
+			file_sec = seconds_since(start);
+			std::remove(opt.tmpfile.c_str());
+			if(ingested.text_length() != text.size()){
+				++file_mismatches;
+			}
+		}
+
+		out << "    {\n"
+		    << "      \"corpus\": \"" << cfg.corpus << "\", \"sigma\": " << cfg.sigma
+		    << ", \"q\": " << cfg.param_q << ", \"k\": " << cfg.param_k
+		    << ", \"text_length\": " << text.size() << ",\n"
+		    << "      \"append\": {\"seconds\": " << build_sec
+		    << ", \"chars_per_sec\": " << (build_sec > 0 ? text.size() / build_sec : 0) << "},\n"
+		    << "      \"assign_parallel\": {\"seconds\": " << parallel_sec
+		    << ", \"chars_per_sec\": " << (parallel_sec > 0 ? text.size() / parallel_sec : 0) << "},\n"
+		    << "      \"append_file\": {\"seconds\": " << file_sec
+		    << ", \"chars_per_sec\": " << (file_sec > 0 ? text.size() / file_sec : 0) << "},\n"
+		    << "      \"memory_bytes\": " << idx.memory_usage() << ",\n";
+
+		sdci::semidynamic_compact_index compacted(idx);
+		start = clock_type::now();
+		compacted.compact_directory();
+		const double compact_sec = seconds_since(start);
+		out << "      \"compact_directory\": {\"seconds\": " << compact_sec
+		    << ", \"memory_bytes\": " << compacted.memory_usage() << "},\n";
+
+		// patterns are substrings of the text, so that every query has occurrences
+		std::uniform_int_distribution<size_type> pos_dist(0, text.size() - idx.max_pattern_length());
+		size_type mismatches = file_mismatches;
+		out << "      \"patterns\": [\n";
+		for(size_type len = 1; len <= idx.max_pattern_length(); ++len){
+			std::vector<std::vector<size_type> > patterns(opt.num_queries);
+			for(size_type i = 0; i < patterns.size(); ++i){
+				const size_type p = pos_dist(rng);
+				patterns[i].assign(text.begin() + p, text.begin() + p + len);
+			}
+
+			std::vector<double> locate_lat, compact_lat, count_lat, naive_lat;
+			std::vector<size_type> occ;
+			size_type total_occ = 0;
+			for(size_type i = 0; i < patterns.size(); ++i){
+				occ.clear();
+				start = clock_type::now();
+				idx.locate(patterns[i].begin(), patterns[i].end(), std::back_inserter(occ));
+				locate_lat.push_back(seconds_since(start));
+				total_occ += occ.size();
+				const size_type num_occ = occ.size();
+
+				occ.clear();
+				start = clock_type::now();
+				compacted.locate(patterns[i].begin(), patterns[i].end(), std::back_inserter(occ));
+				compact_lat.push_back(seconds_since(start));
+				if(occ.size() != num_occ){
+					++mismatches;
+				}
+
+				start = clock_type::now();
+				const size_type cnt = idx.count(patterns[i].begin(), patterns[i].end());
+				count_lat.push_back(seconds_since(start));
+				if(cnt != num_occ){
+					++mismatches;
+				}
+			}
+			for(size_type i = 0; i < std::min(opt.num_naive_queries, patterns.size()); ++i){
+				start = clock_type::now();
+				const size_type cnt = naive_count(text, patterns[i]);
+				naive_lat.push_back(seconds_since(start));
+				if(cnt != idx.count(patterns[i].begin(), patterns[i].end())){
+					++mismatches;
+				}
+			}
+
+			// one substitution, by locate_approx and by locating every variant of the pattern,
+			// in alternating order so that neither runs with the caches warmed by the other
+			std::vector<double> hamming_lat, variants_lat, edit_lat;
+			std::vector<size_type> variant_occ;
+			for(size_type i = 0; i < std::min(opt.num_naive_queries, patterns.size()); ++i){
+				for(size_type turn = 0; turn < 2; ++turn){
+					if((turn + i) % 2 == 0){
+						occ.clear();
+						start = clock_type::now();
+						idx.locate_approx(patterns[i].begin(), patterns[i].end(), 1,
+							sdci::semidynamic_compact_index::hamming_distance, std::back_inserter(occ));
+						hamming_lat.push_back(seconds_since(start));
+						continue;
+					}
+					variant_occ.clear();
+					start = clock_type::now();
+					std::vector<size_type> variant = patterns[i];
+					for(size_type j = 0; j < len; ++j){
+						for(size_type ch = 0; ch < cfg.sigma; ++ch){
+							if(ch != patterns[i][j] || j == 0){
+								variant[j] = ch;
+								idx.locate(variant.begin(), variant.end(), std::back_inserter(variant_occ));
+							}
+						}
+						variant[j] = patterns[i][j];
+					}
+					std::sort(variant_occ.begin(), variant_occ.end());
+					variant_occ.erase(std::unique(variant_occ.begin(), variant_occ.end()), variant_occ.end());
+					variants_lat.push_back(seconds_since(start));
+				}
+				if(occ.size() != variant_occ.size()){
+					++mismatches;
+				}
+
+				if(len < idx.max_pattern_length()){
+					start = clock_type::now();
+					idx.locate_approx(patterns[i].begin(), patterns[i].end(), 1,
+						sdci::semidynamic_compact_index::edit_distance, sdci::detail::count_iterator());
+					edit_lat.push_back(seconds_since(start));
+				}
+			}
+
+			// a don't-care at the second position and a class of two characters at the last one,
+			// by one locate of the class pattern and by locating every expansion of it, in alternating order
+			std::vector<double> class_lat, expanded_lat;
+			for(size_type i = 0; len >= 3 && i < std::min(opt.num_naive_queries, patterns.size()); ++i){
+				const size_type last_ch = patterns[i][len - 1];
+				const size_type last_class[] = {last_ch, (last_ch + 1) % cfg.sigma};
+				sdci::class_pattern pattern;
+				for(size_type j = 0; j < len; ++j){
+					if(j == 1){
+						pattern.push_back_any();
+					}
+					else if(j == len - 1){
+						pattern.push_back_class(last_class, last_class + 2);
+					}
+					else{
+						pattern.push_back(patterns[i][j]);
+					}
+				}
+				size_type num_occ = 0;
+				sdci::detail::count_iterator expanded;
+				for(size_type turn = 0; turn < 2; ++turn){
+					if((turn + i) % 2 == 0){
+						start = clock_type::now();
+						num_occ = idx.locate(pattern, sdci::detail::count_iterator()).count();
+						class_lat.push_back(seconds_since(start));
+						continue;
+					}
+					start = clock_type::now();
+					std::vector<size_type> expansion = patterns[i];
+					for(size_type ch = 0; ch < cfg.sigma; ++ch){
+						expansion[1] = ch;
+						for(size_type c = 0; c < 2; ++c){
+							expansion[len - 1] = last_class[c];
+							expanded = idx.locate(expansion.begin(), expansion.end(), expanded);
+						}
+					}
+					expanded_lat.push_back(seconds_since(start));
+				}
+				if(expanded.count() != num_occ){
+					++mismatches;
+				}
+			}
+
+			out << "        {\"pattern_length\": " << len
+			    << ", \"mean_occurrences\": " << double(total_occ) / patterns.size() << ",\n"
+			    << "         \"locate\": {";
+			write_summary(out, summarize(locate_lat));
+			out << "},\n         \"locate_compact\": {";
+			write_summary(out, summarize(compact_lat));
+			out << "},\n         \"count\": {";
+			write_summary(out, summarize(count_lat));
+			out << "},\n         \"naive_scan\": {";
+			write_summary(out, summarize(naive_lat));
+			out << "},\n         \"locate_hamming1\": {";
+			write_summary(out, summarize(hamming_lat));
+			out << "},\n         \"locate_variants1\": {";
+			write_summary(out, summarize(variants_lat));
+			out << "},\n         \"locate_edit1\": {";
+			write_summary(out, summarize(edit_lat));
+			out << "},\n         \"locate_class\": {";
+			write_summary(out, summarize(class_lat));
+			out << "},\n         \"locate_expanded\": {";
+			write_summary(out, summarize(expanded_lat));
+			out << "}}" << (len < idx.max_pattern_length() ? "," : "") << "\n";
+		}
+		out << "      ],\n";
+
+		// a mixed batch of locate and count queries through query_executor
+		std::vector<sdci::query_request> requests(opt.num_queries);
+		for(size_type i = 0; i < requests.size(); ++i){
+			const size_type len = 1 + i % idx.max_pattern_length();
+			const size_type p = pos_dist(rng);
+			requests[i].kind = (i % 2 == 0 ? sdci::query_request::locate_query : sdci::query_request::count_query);
+			requests[i].pattern.assign(text.begin() + p, text.begin() + p + len);
+		}
+		const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+		out << "      \"executor\": [\n";
+		for(unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)){
+			sdci::query_executor executor(idx, threads);
+			std::vector<sdci::query_result> results;
+			start = clock_type::now();
+			executor.run(requests, results);
+			const double sec = seconds_since(start);
+			out << "        {\"threads\": " << threads
+			    << ", \"queries_per_sec\": " << (sec > 0 ? requests.size() / sec : 0)
+			    << ", \"per_thread_queries_per_sec\": [";
+			for(unsigned t = 0; t < threads; ++t){
+				const sdci::query_worker_stats &st = executor.last_stats()[t];
+				out << (t ? ", " : "") << (st.busy_seconds > 0 ? st.queries / st.busy_seconds : 0);
+			}
+			out << "]}" << (threads < max_threads ? "," : "") << "\n";
+			if(threads == max_threads){
+				break;
+			}
+		}
+		out << "      ],\n";
+
+		std::vector<size_type> retrieved(text.size());
+		start = clock_type::now();
+		idx.retrieve(retrieved.begin());
+		const double retrieve_sec = seconds_since(start);
+		if(retrieved != text){
+			++mismatches;
+		}
+
+		const size_type num_extract = std::max<size_type>(1, opt.num_queries / 10);
+		const size_type extract_len = 100;
+		std::vector<double> extract_lat;
+		std::vector<size_type> extracted(extract_len);
+		std::uniform_int_distribution<size_type> from_dist(0, text.size() - 1);
+		for(size_type i = 0; i < num_extract; ++i){
+			const size_type from = from_dist(rng);
+			start = clock_type::now();
+			const std::vector<size_type>::iterator last = idx.extract(from, extract_len, extracted.begin());
+			extract_lat.push_back(seconds_since(start));
+			if(!std::equal(extracted.begin(), last, text.begin() + from)){
+				++mismatches;
+			}
+		}
+
+		out << "      \"retrieve\": {\"seconds\": " << retrieve_sec
+		    << ", \"chars_per_sec\": " << (retrieve_sec > 0 ? text.size() / retrieve_sec : 0) << "},\n"
+		    << "      \"extract\": {\"length\": " << extract_len << ", ";
+		write_summary(out, summarize(extract_lat));
+		out << "},\n";
+
+		start = clock_type::now();
+		idx.save_file(opt.tmpfile.c_str());
+		const double save_sec = seconds_since(start);
+		const size_type bytes = file_size(opt.tmpfile);
+
+		sdci::semidynamic_compact_index loaded;
+		start = clock_type::now();
+		loaded.load_file(opt.tmpfile.c_str());
+		const double load_sec = seconds_since(start);
+
+		// the time until the first query is answered from a mapped file
+		sdci::semidynamic_compact_index mapped;
+		start = clock_type::now();
+		mapped.map_file(opt.tmpfile.c_str());
+		const size_type first_count = mapped.count(text.begin(), text.begin() + mapped.max_pattern_length());
+		const double map_sec = seconds_since(start);
+		std::remove(opt.tmpfile.c_str());
+		if(loaded.text_length() != idx.text_length() ||
+			first_count != idx.count(text.begin(), text.begin() + idx.max_pattern_length())
+		){
+			++mismatches;
+		}
+
+		// an index initialized again with other parameters must not keep the entries of its old text
+		const size_type reinit_len = std::min<size_type>(text.size() / 2, 100000);
+		sdci::semidynamic_compact_index reinitialized(cfg.sigma, cfg.param_q, cfg.param_k);
+		reinitialized.append(text.begin(), text.begin() + reinit_len);
+		reinitialized.initialize(cfg.sigma, cfg.param_q - 1, 1);
+		const std::vector<size_type> reinit_text(text.begin() + reinit_len, text.begin() + 2 * reinit_len);
+		reinitialized.append(reinit_text.begin(), reinit_text.end());
+		std::vector<size_type> reinit_retrieved(reinitialized.text_length());
+		reinitialized.retrieve(reinit_retrieved.begin());
+		if(reinit_retrieved != reinit_text){
+			++mismatches;
+		}
+		const size_type reinit_ptn_len = reinitialized.max_pattern_length();
+		for(size_type i = 0; i < opt.num_naive_queries; ++i){
+			const size_type p = (reinit_len - reinit_ptn_len) * i / opt.num_naive_queries;
+			const std::vector<size_type> pattern(reinit_text.begin() + p, reinit_text.begin() + p + reinit_ptn_len);
+			if(reinitialized.count(pattern.begin(), pattern.end()) != naive_count(reinit_text, pattern)){
+				++mismatches;
+			}
+		}
+
+		out << "      \"save\": {\"bytes\": " << bytes << ", \"seconds\": " << save_sec
+		    << ", \"mb_per_sec\": " << (save_sec > 0 ? bytes / save_sec / 1e6 : 0) << "},\n"
+		    << "      \"load\": {\"bytes\": " << bytes << ", \"seconds\": " << load_sec
+		    << ", \"mb_per_sec\": " << (load_sec > 0 ? bytes / load_sec / 1e6 : 0) << "},\n"
+		    << "      \"map_and_first_query\": {\"seconds\": " << map_sec << "},\n"
+		    << "      \"mismatches\": " << mismatches << "\n"
+		    << "    }";
+
+		if(mismatches != 0){
+			std::cerr << "sdci_bench: " << mismatches << " mismatches in "
+			          << cfg.corpus << " (" << cfg.sigma << ", " << cfg.param_q << ", "
+			          << cfg.param_k << ")" << std::endl;
+		}
+		return mismatches;
+	}
+
+	void usage(){
+		std::cerr << "Usage: sdci_bench [--length N] [--queries Q] [--pages P] [--seed S] [--out FILE]" << std::endl;
+		std::exit(1);
+	}
+}
+
+int main(int argc, char **argv){
+	bench_options opt;
+	opt.text_length = 1 << 22;
+	opt.num_queries = 1000;
+	opt.num_naive_queries = 20;
+	opt.seed = 1;
+	opt.tmpfile = "sdci_bench.tmp";
+	opt.pages = "normal";
+
+	for(int i = 1; i < argc; ++i){
+		if(i + 1 >= argc){
+			usage();
+		}
+		if(std::strcmp(argv[i], "--length") == 0){
+			opt.text_length = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--queries") == 0){
+			opt.num_queries = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--pages") == 0){
+			opt.pages = argv[++i];
+		}
+		else if(std::strcmp(argv[i], "--seed") == 0){
+			opt.seed = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--out") == 0){
+			opt.output = argv[++i];
+		}
+		else{
+			usage();
+		}
+	}
+	if(opt.text_length < 1000 || opt.num_queries == 0){
+		usage();
+	}
+	static const char *const page_names[] = {"normal", "transparent_huge", "huge_2m", "huge_1g"};
+	size_type pages = 0;
+	while(pages < 4 && opt.pages != page_names[pages]){
+		++pages;
+	}
+	if(pages == 4){
+		usage();
+	}
+	sdci::memory_options memory;
+	memory.pages = static_cast<sdci::memory_options::page_type>(pages);
+	memory.prefault = true;
+	sdci::set_memory_options(memory);
+
+	std::ofstream file;
+	if(!opt.output.empty()){
+		file.open(opt.output.c_str());
+		if(!file.good()){
+			std::cerr << "sdci_bench: cannot open " << opt.output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream &out = opt.output.empty() ? std::cout : file;
+
+	out << "{\n"
+	    << "  \"benchmark\": \"semidynamic_compact_index\",\n"
+	    << "  \"text_length\": " << opt.text_length << ",\n"
+	    << "  \"queries_per_length\": " << opt.num_queries << ",\n"
+	    << "  \"seed\": " << opt.seed << ",\n"
+	    << "  \"pages\": \"" << opt.pages << "\",\n"
+	    << "  \"results\": [\n";
+	const size_type num_configs = sizeof(configs) / sizeof(configs[0]);
+	size_type mismatches = 0;
+	for(size_type i = 0; i < num_configs; ++i){
+		mismatches += run_config(out, configs[i], opt);
+		out << (i + 1 < num_configs ? ",\n" : "\n");
+		out.flush();
+	}
+	out << "  ]\n}\n";
+
+	// so that make bench fails on a wrong result
+	if(mismatches != 0){
+		std::cerr << "sdci_bench: " << mismatches << " mismatches in total" << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,165 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "concurrent_compact_index.h"
+#include <thread>
+#include <algorithm>
+
+namespace sdci{
+	concurrent_compact_index::concurrent_compact_index
+	(size_type sigma_, size_type param_q_, size_type param_k_)
+	: m_active(0), m_version(0), m_published_length(0), m_tail_base(0), m_drain_stage(0), m_drain_version(0)
+	{
+		m_replicas[0].initialize(sigma_, param_q_, param_k_);
+		m_replicas[1].initialize(sigma_, param_q_, param_k_);
+		m_readers[0].count.store(0);
+		m_readers[1].count.store(0);
+		m_pending_reserve[0] = m_pending_reserve[1] = 0;
+	}
+
+	concurrent_compact_index::concurrent_compact_index(const semidynamic_compact_index &index)
+	: m_active(0), m_version(0), m_published_length(index.text_length()), m_tail_base(index.text_length()),
+	  m_drain_stage(0), m_drain_version(0)
+	{
+		m_replicas[0] = index;
+		m_replicas[1] = index;
+		m_readers[0].count.store(0);
+		m_readers[1].count.store(0);
+		m_pending_reserve[0] = m_pending_reserve[1] = 0;
+	}
+
+	void concurrent_compact_index::reserve(size_type reserve_size_){
+		std::lock_guard<std::mutex> lock(m_writer_mtx);
+		m_pending_reserve[0] = std::max(m_pending_reserve[0], reserve_size_);
+		m_pending_reserve[1] = std::max(m_pending_reserve[1], reserve_size_);
+		if(m_drain_stage == 0){
+			const size_type writer = 1 - m_active.load();
+			m_replicas[writer].reserve(m_pending_reserve[writer]);
+			m_pending_reserve[writer] = 0;
+		}
+	}
+
+	void concurrent_compact_index::publish(){
+		publish_until(clock_type::time_point(), false);
+	}
+
+	/*
+		The readers and the writer follow the left-right technique.
+		A reader registers itself to the counter of the current version
+		before it reads which replica is active.
+		After switching the active replica,
+		the writer waits for the readers of both versions in turn,
+		so that no reader can still be using the inactive replica.
+		The waits may be given up at a deadline and resumed by the next call.
+	*/
+	bool concurrent_compact_index::publish_until(clock_type::time_point deadline, bool bounded){
+		std::lock_guard<std::mutex> lock(m_writer_mtx);
+		if(m_drain_stage != 0 && !finish_drain(deadline, bounded)){
+			return false;
+		}
+		if(m_published_length.load() == m_tail_base + m_tail.size()){
+			return true;
+		}
+
+		const size_type next = 1 - m_active.load();
+		m_active.store(next);
+		m_published_length.store(m_replicas[next].text_length());
+
+		m_drain_version = m_version.load();
+		m_drain_stage = 1;
+		finish_drain(deadline, bounded);
+		return true;
+	}
+
+	bool concurrent_compact_index::finish_drain(clock_type::time_point deadline, bool bounded){
+		if(m_drain_stage == 1){
+			if(!wait_for_readers(1 - m_drain_version, deadline, bounded)){
+				return false;
+			}
+			m_version.store(1 - m_drain_version);
+			m_drain_stage = 2;
+		}
+		if(!wait_for_readers(m_drain_version, deadline, bounded)){
+			return false;
+		}
+		m_drain_stage = 0;
+		catch_up();
+		return true;
+	}
+
+	// appends the characters which the writer's replica does not have yet
+	void concurrent_compact_index::catch_up(){
+		const size_type writer = 1 - m_active.load();
+		semidynamic_compact_index &target = m_replicas[writer];
+		if(m_pending_reserve[writer] != 0){
+			target.reserve(m_pending_reserve[writer]);
+			m_pending_reserve[writer] = 0;
+		}
+		target.append(m_tail.begin() + (target.text_length() - m_tail_base), m_tail.end());
+
+		// the published replica does not have the characters after the published text
+		const size_type published = m_published_length.load();
+		m_tail.erase(m_tail.begin(), m_tail.begin() + (published - m_tail_base));
+		m_tail_base = published;
+	}
+
+	concurrent_compact_index::snapshot
+	concurrent_compact_index::acquire() const{
+		const size_type version = m_version.load();
+		m_readers[version].count.fetch_add(1);
+		return snapshot(this, version, &m_replicas[m_active.load()]);
+	}
+
+	bool concurrent_compact_index::wait_for_readers
+	(size_type version, clock_type::time_point deadline, bool bounded) const
+	{
+		while(m_readers[version].count.load() != 0){
+			if(bounded && clock_type::now() >= deadline){
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	void concurrent_compact_index::leave(size_type version) const{
+		m_readers[version].count.fetch_sub(1);
+	}
+
+	concurrent_compact_index::snapshot::snapshot
+	(const concurrent_compact_index *owner, size_type version, const semidynamic_compact_index *index)
+	: m_owner(owner), m_version(version), m_index(index)
+	{
+	}
+
+	concurrent_compact_index::snapshot::snapshot(snapshot &&other)
+	: m_owner(other.m_owner), m_version(other.m_version), m_index(other.m_index)
+	{
+		other.m_owner = 0;
+	}
+
+	concurrent_compact_index::snapshot::~snapshot(){
+		if(m_owner != 0){
+			m_owner->leave(m_version);
+		}
+	}
+}
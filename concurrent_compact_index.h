@@ -0,0 +1,261 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SDCI_CONCURRENT_COMPACT_INDEX_H_INCLUDED
+#define SDCI_CONCURRENT_COMPACT_INDEX_H_INCLUDED
+
+#include "semidynamic_compact_index.h"
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+
+namespace sdci{
+	/*
+		A semidynamic_compact_index which one writer appends to while many readers query it.
+
+		The index is kept in two replicas.
+		The writer appends to the replica which no reader can access,
+		and publish() makes it the replica for new readers.
+		After the readers of the other replica have left,
+		the same characters are appended to it, which becomes the writer's replica.
+		Thus readers never wait for the writer,
+		and each reader sees the text as of some publish(),
+		even when the writer reallocates the arrays in reserve() or append().
+
+		Note
+		- This class requires twice as much memory as semidynamic_compact_index,
+		  and each character is appended twice.
+		- publish() blocks the writer until the readers of the replica published before have left,
+		  so a snapshot held for a long time stalls the writer.
+		  publish_for() bounds the wait: while such readers remain,
+		  the characters appended are buffered (one size_type each) and not published.
+	*/
+	class concurrent_compact_index{
+	public:
+		typedef semidynamic_compact_index::size_type size_type;
+
+		class snapshot;
+
+		/*
+			Creates index of empty text.
+
+			Parameters
+			- sigma: The alphabet size.
+			- param_q: The parameter q.
+			- param_k: The parameter k.
+
+			Preconditions
+			- The same as semidynamic_compact_index(sigma, param_q, param_k).
+		*/
+		concurrent_compact_index(size_type sigma, size_type param_q, size_type param_k);
+
+		/*
+			Creates index of the text of given index.
+			The text is published.
+		*/
+		explicit concurrent_compact_index(const semidynamic_compact_index &index);
+
+		/*
+			Reserves the space for the text of given length.
+			This function must be called by the writer.
+		*/
+		void reserve(size_type expected_max_text_length);
+
+		/*
+			Appends characters after the current text.
+			The characters are not visible to readers until publish() is called.
+			This function must be called by the writer.
+
+			Parameters
+			- first, last: Input iterators to the initial and final positions of the appending characters. The range used is [first, last).
+
+			Note
+			- If a value in [first, last) is not less than alphabet_size, std::invalid_argument is thrown
+			  and no character is appended.
+		*/
+		template <class InputIterator>
+		void append(InputIterator first, InputIterator last);
+
+		/*
+			Makes the appended characters visible to readers.
+			This function must be called by the writer.
+
+			Note
+			- This function waits until the readers which started before the last publish() finish.
+			  Holding a snapshot for a long time delays the writer, but never other readers.
+		*/
+		void publish();
+
+		/*
+			The same as publish(), but waits for the readers for at most given time.
+			Returns true if the appended characters are visible to readers.
+			This function must be called by the writer.
+
+			Note
+			- If this function returns false, the readers of the replica published before have not left,
+			  and the characters are published by a later call of publish() or publish_for().
+			- If the characters are published but the readers of the previous replica do not leave in time,
+			  true is returned, and the previous replica is updated by a later call of append() or publish().
+		*/
+		template <class Rep, class Period>
+		bool publish_for(const std::chrono::duration<Rep, Period> &timeout);
+
+		/*
+			Returns the length of text which the writer has appended,
+			including the characters not yet published.
+			This function must be called by the writer.
+		*/
+		size_type text_length() const;
+
+		/*
+			Returns the length of the published text.
+			This function can be called by any thread.
+		*/
+		size_type published_length() const;
+
+		/*
+			Returns a snapshot of the published text, on which queries can be made.
+			This function can be called by any thread.
+		*/
+		snapshot acquire() const;
+
+#if __cplusplus >= 201103L
+		concurrent_compact_index(const concurrent_compact_index &) = delete;
+		concurrent_compact_index& operator= (const concurrent_compact_index &) = delete;
+#endif
+
+	private:
+		typedef std::chrono::steady_clock clock_type;
+
+		// the counter of readers, in its own cache line
+		struct reader_counter{
+			std::atomic<size_type> count;
+			char padding[64 - sizeof(std::atomic<size_type>)];
+		};
+
+		bool publish_until(clock_type::time_point deadline, bool bounded);
+		bool finish_drain(clock_type::time_point deadline, bool bounded);
+		void catch_up();
+		bool wait_for_readers(size_type version, clock_type::time_point deadline, bool bounded) const;
+		void leave(size_type version) const;
+
+		semidynamic_compact_index m_replicas[2];
+		std::atomic<size_type> m_active;
+		std::atomic<size_type> m_version;
+		mutable reader_counter m_readers[2];
+		std::atomic<size_type> m_published_length;
+
+		// the text from position m_tail_base, which one of the replicas does not have yet
+		std::vector<size_type> m_tail;
+		size_type m_tail_base;
+		size_type m_pending_reserve[2];
+
+		// 0 if the writer's replica has no reader,
+		// or the step of waiting for its readers after the switch from version m_drain_version
+		size_type m_drain_stage;
+		size_type m_drain_version;
+		std::mutex m_writer_mtx;
+	};
+
+	/*
+		A published state of a concurrent_compact_index.
+		While a snapshot is held, the replica which it refers to is not modified.
+	*/
+	class concurrent_compact_index::snapshot{
+	public:
+		/*
+			Returns the index of the published text.
+		*/
+		const semidynamic_compact_index& index() const;
+
+		const semidynamic_compact_index* operator-> () const;
+
+		snapshot(snapshot &&other);
+		~snapshot();
+
+#if __cplusplus >= 201103L
+		snapshot(const snapshot &) = delete;
+		snapshot& operator= (const snapshot &) = delete;
+#endif
+
+	private:
+		friend class concurrent_compact_index;
+
+		snapshot(const concurrent_compact_index *owner, size_type version, const semidynamic_compact_index *index);
+
+		const concurrent_compact_index *m_owner;
+		size_type m_version;
+		const semidynamic_compact_index *m_index;
+	};
+
+	template <class InputIterator>
+	void concurrent_compact_index::append(InputIterator first, InputIterator last){
+		std::lock_guard<std::mutex> lock(m_writer_mtx);
+		const size_type sigma = m_replicas[0].alphabet_size();
+		const size_type old_size = m_tail.size();
+		for(; first != last; ++first){
+			const size_type ch = static_cast<size_type>(*first);
+			if(ch >= sigma){
+				m_tail.resize(old_size);
+				throw std::invalid_argument("concurrent_compact_index::append");
+			}
+			m_tail.push_back(ch);
+		}
+		if(m_drain_stage == 0){
+			m_replicas[1 - m_active.load()].append(m_tail.begin() + old_size, m_tail.end());
+		}
+		else{
+			// the characters stay in m_tail unless the readers of the writer's replica have just left
+			finish_drain(clock_type::time_point(), true);
+		}
+	}
+
+	template <class Rep, class Period>
+	bool concurrent_compact_index::publish_for(const std::chrono::duration<Rep, Period> &timeout){
+		return publish_until(clock_type::now() + std::chrono::duration_cast<clock_type::duration>(timeout), true);
+	}
+
+	inline concurrent_compact_index::size_type
+	concurrent_compact_index::text_length() const{
+		return m_tail_base + m_tail.size();
+	}
+
+	inline concurrent_compact_index::size_type
+	concurrent_compact_index::published_length() const{
+		return m_published_length.load();
+	}
+
+	inline const semidynamic_compact_index&
+	concurrent_compact_index::snapshot::index() const{
+		return *m_index;
+	}
+
+	inline const semidynamic_compact_index*
+	concurrent_compact_index::snapshot::operator-> () const{
+		return m_index;
+	}
+}
+
+#endif
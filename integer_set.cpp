@@ -25,17 +25,21 @@
 namespace sdci{
 	namespace detail{
 
-		integer_set::integer_set(size_type new_size){
+		integer_set::integer_set(size_type new_size)
+		: ranked(false)
+		{
 			initialize(new_size);
 		}
 
 #if __cplusplus >= 201103L
 		integer_set::integer_set(integer_set&& other)
 		: width(other.width), cnt(other.cnt),
-		  buf(std::move(other.buf)), offset(std::move(other.offset))
+		  buf(std::move(other.buf)), offset(std::move(other.offset)),
+		  ranked(other.ranked), rank_dir(std::move(other.rank_dir))
 		{
 			other.width = 0;
 			other.cnt = 0;
+			other.ranked = false;
 		}
 
 		integer_set& integer_set::operator= (integer_set&& other){
@@ -48,11 +52,16 @@ namespace sdci{
 			width = new_size;
 			cnt = 0;
 			size_type sum = calc_offset();
-			buf.assign(sum, 0);
+			buf.clear();
+			buf.resize(sum);
+			if(ranked){
+				build_rank_directory();
+			}
 		} catch(...){
 			width = 0;
 			buf.clear();
 			offset.clear();
+			::sdci::detail::prefix_sum_array().swap(rank_dir);
 			throw;
 		}
 
@@ -61,6 +70,9 @@ namespace sdci{
 				return false;
 			}
 			size_type pos = pos_signed;
+			if(ranked){
+				rank_dir.increment(pos / (value_width * rank_block_words));
+			}
 			++cnt;
 			bool cont_flag = true;
 			std::vector<size_type>::iterator level = offset.begin();
@@ -77,6 +89,9 @@ namespace sdci{
 		bool integer_set::erase(const value_type pos_signed){
 			if(contains(pos_signed)){
 				size_type pos = pos_signed;
+				if(ranked){
+					rank_dir.decrement(pos / (value_width * rank_block_words));
+				}
 				--cnt;
 				bool cont_flag = true;
 				std::vector<size_type>::iterator level = offset.begin();
@@ -95,7 +110,8 @@ namespace sdci{
 
 		void integer_set::clear(){
 			if(cnt != 0){	
-				std::fill(buf.begin(), buf.end(), data_type());
+				buf.fill(data_type());
+				rank_dir.clear();
 				cnt = 0;
 			}
 		}
@@ -172,6 +188,91 @@ namespace sdci{
 			return value_type(pos);
 		}
 
+		void integer_set::enable_rank(bool enable){
+			if(!enable){
+				::sdci::detail::prefix_sum_array().swap(rank_dir);
+				ranked = false;
+				return;
+			}
+			build_rank_directory();
+			ranked = true;
+		}
+
+		void integer_set::build_rank_directory(){
+			const size_type words = (width + (value_width - 1)) / value_width;
+			const size_type blocks = (words + (rank_block_words - 1)) / rank_block_words;
+			::sdci::detail::prefix_sum_array dir(blocks);
+			dir.reserve(cnt);
+			for(size_type b = 0; b < blocks; ++b){
+				const size_type last = std::min<size_type>(words, (b + 1) * rank_block_words);
+				size_type c = 0;
+				for(size_type i = b * rank_block_words; i < last; ++i){
+					c += ::sdci::detail::popcount64(buf[i]);
+				}
+				dir.add(b, c);
+			}
+			rank_dir.swap(dir);
+		}
+
+		integer_set::size_type integer_set::rank(size_type pos) const{
+			if(pos >= width){
+				return cnt;
+			}
+			const size_type word = pos / value_width;
+			size_type i = 0;
+			size_type ret = 0;
+			if(ranked){
+				i = word / rank_block_words * rank_block_words;
+				ret = rank_dir.prefix_sum(word / rank_block_words);
+			}
+			for(; i < word; ++i){
+				ret += ::sdci::detail::popcount64(buf[i]);
+			}
+			return ret + ::sdci::detail::popcount64(buf[word] & ((data_type(1) << (pos % value_width)) - 1));
+		}
+
+		integer_set::value_type integer_set::select(size_type rank) const{
+			if(rank >= cnt){
+				return value_type(width);
+			}
+			size_type word = 0;
+			if(ranked){
+				const size_type block = rank_dir.search(rank);
+				rank -= rank_dir.prefix_sum(block);
+				word = block * rank_block_words;
+			}
+			while(true){
+				const size_type c = ::sdci::detail::popcount64(buf[word]);
+				if(rank < c){
+					break;
+				}
+				rank -= c;
+				++word;
+			}
+			return value_type(word * value_width + ::sdci::detail::select64(buf[word], unsigned(rank)));
+		}
+
+		integer_set::range_iterator::range_iterator()
+		: m_words(0), m_offset(0), m_first(0), m_last(0), m_top(0), m_level(0)
+		{
+			m_bits[0] = 0;
+		}
+
+		integer_set::range_iterator::range_iterator(const integer_set &set, size_type first, size_type last)
+		: m_words(set.buf.data()), m_offset(set.offset.empty() ? 0 : &set.offset[0]),
+		  m_first(first), m_last(std::min(last, set.width)), m_top(0), m_level(0)
+		{
+			m_bits[0] = 0;
+			if(m_first >= m_last){
+				return;
+			}
+			// the top level consists of one word
+			m_top = set.offset.size() - 1;
+			m_level = m_top;
+			m_word[m_top] = 0;
+			m_bits[m_top] = load(m_top, 0);
+		}
+
 		integer_set::size_type integer_set::calc_offset(){
 			size_type sum = 0;
 			offset.clear();
@@ -189,20 +290,67 @@ namespace sdci{
 		void integer_set::save_stream(std::ostream &stream) const{
 			::sdci::detail::write_data(stream, &width);
 			::sdci::detail::write_data(stream, &cnt);
-			::sdci::detail::write_vector(stream, buf);
+			buf.save_stream(stream);
 		}
 
 		void integer_set::load_stream(std::istream &stream) try{
 			::sdci::detail::read_data(stream, &width);
 			::sdci::detail::read_data(stream, &cnt);
-			::sdci::detail::read_vector(stream, buf);
+			buf.load_stream(stream);
 			calc_offset();
+			if(ranked){
+				build_rank_directory();
+			}
+		}
+		catch(...){
+			width = 0;
+			cnt = 0;
+			buf.clear();
+			offset.clear();
+			::sdci::detail::prefix_sum_array().swap(rank_dir);
+			throw;
+		}
+
+		// Writes the parameters of the set, whose bits are kept in a file.
+		void integer_set::save_header(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &width);
+			::sdci::detail::write_data(stream, &cnt);
+		}
+
+		void integer_set::open_file(std::istream &header, const std::string &filename) try{
+			::sdci::detail::read_data(header, &width);
+			::sdci::detail::read_data(header, &cnt);
+			buf.open_file(filename, calc_offset());
+			if(ranked){
+				build_rank_directory();
+			}
+		}
+		catch(...){
+			width = 0;
+			cnt = 0;
+			buf.clear();
+			offset.clear();
+			::sdci::detail::prefix_sum_array().swap(rank_dir);
+			throw;
+		}
+
+		void integer_set::map_memory(::sdci::detail::mapped_reader &reader) try{
+			reader.read(&width);
+			reader.read(&cnt);
+			reader.read_words(buf);
+			if(buf.size() != calc_offset()){
+				::sdci::detail::formaterr();
+			}
+			if(ranked){
+				build_rank_directory();
+			}
 		}
 		catch(...){
 			width = 0;
 			cnt = 0;
 			buf.clear();
 			offset.clear();
+			::sdci::detail::prefix_sum_array().swap(rank_dir);
 			throw;
 		}
 	}
@@ -30,6 +30,9 @@
 #include <new>
 #include <iostream>
 #include <utility>
+#include <string>
+#include "word_buffer.h"
+#include "prefix_sum_array.h"
 
 #if __cplusplus >= 201103L
 #include <type_traits>
@@ -51,12 +54,13 @@ namespace sdci{
 		private:
 			typedef sdci::detail::uint64_type data_type;
 
-			enum{ value_width = 64 };
+			enum{ value_width = 64, rank_block_words = 8 };
 
 		public:
 			explicit integer_set(size_type new_size = 0);
 
 #if __cplusplus >= 201103L
+			integer_set(const integer_set&) = default;
 			integer_set(integer_set&& other);
 			integer_set& operator= (const integer_set&) = default;
 			integer_set& operator= (integer_set&& other);
@@ -70,12 +74,55 @@ namespace sdci{
 			void clear();
 			value_type successor(value_type pos) const;
 			value_type predecessor(value_type pos) const;
+
+			class range_iterator;
+
+			/*
+				Calls f(pos) for each element pos in [first, last) in ascending order.
+				The time is proportional to the number of words containing elements or their summaries,
+				instead of a descent of the levels for each element as repeated successor() does.
+			*/
+			template <class Function>
+			void for_each_in_range(size_type first, size_type last, Function f) const;
 			size_type limit() const;
 			size_type size() const;
+
+			/*
+				Builds or releases the rank directory, which keeps the number of elements
+				in each block of rank_block_words words with prefix sums over them.
+				While it exists, insert() and erase() update it in O(log(limit()/512)) time,
+				and rank() and select() take O(log(limit()/512)) time instead of O(limit()/64).
+				The directory is not saved; it is rebuilt when the set is loaded while it is enabled.
+			*/
+			void enable_rank(bool enable = true);
+			bool rank_enabled() const;
+
+			/*
+				Returns the number of elements less than pos.
+			*/
+			size_type rank(size_type pos) const;
+
+			/*
+				Returns the number of elements in [pos - pos % 64, pos) (pos < limit()),
+				so that rank() can be answered in O(1) time from the ranks sampled at every 64 positions.
+			*/
+			size_type word_rank(size_type pos) const;
+
+			/*
+				Returns the (rank+1)-th smallest element, or limit() if rank >= size().
+			*/
+			value_type select(size_type rank) const;
 			void swap(integer_set& other);
 			size_type heap_usage() const;
 			void save_stream(std::ostream &stream) const;
 			void load_stream(std::istream &stream);
+			void map_memory(::sdci::detail::mapped_reader &reader);
+			bool mapped() const;
+			void detach();
+			void attach_file(const std::string &filename);
+			void save_header(std::ostream &stream) const;
+			void open_file(std::istream &header, const std::string &filename);
+			void sync() const;
 
 #if 0
 			void read_stream(std::istream& stream) try{
@@ -98,10 +145,13 @@ namespace sdci{
 		private:
 			size_type width;
 			size_type cnt;
-			std::vector<data_type> buf;
+			::sdci::detail::word_buffer buf;
 			std::vector<size_type> offset;
+			bool ranked;
+			::sdci::detail::prefix_sum_array rank_dir;
 			
 			size_type calc_offset();
+			void build_rank_directory();
 #if 0
 			static const value_type positive_infinity = std::numeric_limits<integer_set::value_type>::max_value();
 			static const value_type negative_infinity = std::numeric_limits<integer_set::value_type>::min_value();
@@ -109,6 +159,90 @@ namespace sdci{
 
 		};
 
+		/*
+			Enumerates the elements in [first, last) of a set in ascending order.
+			It keeps the remaining bits of the current word in each level,
+			so that the summary words are scanned sequentially rather than descended again.
+			It is invalidated when the set is modified.
+		*/
+		class integer_set::range_iterator{
+		public:
+			range_iterator();
+			range_iterator(const integer_set &set, size_type first, size_type last);
+
+			/*
+				Sets pos to the next element and returns true,
+				or returns false if no element remains.
+			*/
+			bool next(size_type &pos);
+
+		private:
+			// 64^11 >= 2^64
+			enum{ max_levels = 11, lg_value_width = 6 };
+
+			const data_type *m_words;
+			const size_type *m_offset;
+			size_type m_first;
+			size_type m_last;
+			size_type m_top;
+			size_type m_level;
+			data_type m_bits[max_levels];
+			size_type m_word[max_levels];
+
+			data_type load(size_type level, size_type word) const;
+		};
+
+		// Returns the word of the level, without the bits for the elements out of [m_first, m_last).
+		inline integer_set::data_type
+		integer_set::range_iterator::load(size_type level, size_type word) const{
+			data_type bits = m_words[m_offset[level] + word];
+			const size_type lo = m_first >> (lg_value_width * level);
+			const size_type hi = (m_last - 1) >> (lg_value_width * level);
+			if(word == lo / value_width){
+				bits &= ~data_type(0) << (lo % value_width);
+			}
+			if(word == hi / value_width){
+				bits &= ~data_type(0) >> (value_width - 1 - hi % value_width);
+			}
+			return bits;
+		}
+
+		inline bool
+		integer_set::range_iterator::next(size_type &pos){
+			size_type level = m_level;
+			while(true){
+				data_type &bits = m_bits[level];
+				if(bits == 0){
+					if(level == m_top){
+						m_level = level;
+						return false;
+					}
+					++level;
+					continue;
+				}
+				const size_type child = m_word[level] * value_width + ::sdci::detail::slsb64(bits);
+				bits &= bits - 1;
+				if(level == 0){
+					m_level = 0;
+					pos = child;
+					return true;
+				}
+				--level;
+				m_word[level] = child;
+				m_bits[level] = load(level, child);
+			}
+		}
+
+		template <class Function>
+		inline void
+		integer_set::for_each_in_range(size_type first, size_type last, Function f) const{
+			range_iterator it(*this, first, last);
+			size_type pos = 0;
+			while(it.next(pos)){
+				f(pos);
+			}
+		}
+
 		inline bool integer_set::contains(value_type pos) const{
 			if(pos + size_type() >= width + value_type()){
 				return false;
@@ -117,6 +251,10 @@ namespace sdci{
 			return (buf[pos_unsig / 64] >> (pos_unsig % 64)) & 1;
 		}
 
+		inline integer_set::size_type integer_set::word_rank(size_type pos) const{
+			return ::sdci::detail::popcount64(buf[pos / value_width] & ((data_type(1) << (pos % value_width)) - 1));
+		}
+
 		inline integer_set::size_type integer_set::limit() const{
 			return width;
 		}
@@ -125,16 +263,40 @@ namespace sdci{
 			return cnt;
 		}
 
+		inline bool integer_set::rank_enabled() const{
+			return ranked;
+		}
+
 		inline void integer_set::swap(integer_set& other){
 			std::swap(width, other.width);
 			std::swap(cnt, other.cnt);
 			buf.swap(other.buf);
 			offset.swap(other.offset);
+			std::swap(ranked, other.ranked);
+			rank_dir.swap(other.rank_dir);
+		}
+
+		// Returns true if the bits are viewed in mapped memory, and then they must not be changed.
+		inline bool integer_set::mapped() const{
+			return buf.is_view();
+		}
+
+		inline void integer_set::detach(){
+			buf.detach();
+		}
+
+		// Moves the bits into the file and keeps them there (see word_buffer).
+		inline void integer_set::attach_file(const std::string &filename){
+			buf.attach_file(filename);
+		}
+
+		inline void integer_set::sync() const{
+			buf.sync();
 		}
 
 		inline integer_set::size_type
 		integer_set::heap_usage() const{
-			return buf.capacity() * sizeof(buf[0]) + offset.capacity() * sizeof(offset[0]);
+			return buf.capacity() * sizeof(buf[0]) + offset.capacity() * sizeof(offset[0]) + rank_dir.heap_usage();
 		}
 	}
 }
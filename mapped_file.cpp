@@ -0,0 +1,640 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mapped_file.h"
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#if !defined(SDCI_NO_USE_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define SDCI_USE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+#endif
+
+namespace sdci{
+	namespace detail{
+#ifdef SDCI_USE_MMAP
+		mapped_file::mapped_file(const char *filename, const map_options &options)
+		: m_addr(0), m_size(0)
+		{
+			const int fd = ::open(filename, O_RDONLY);
+			if(fd < 0){
+				::sdci::detail::ioerr();
+			}
+			struct stat st;
+			if(::fstat(fd, &st) != 0){
+				::close(fd);
+				::sdci::detail::ioerr();
+			}
+			if(st.st_size == 0){
+				::close(fd);
+				::sdci::detail::formaterr();
+			}
+
+			int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+			if(options.prefault){
+				flags |= MAP_POPULATE;
+			}
+#endif
+			void *addr = ::mmap(0, st.st_size, PROT_READ, flags, fd, 0);
+			::close(fd);
+			if(addr == MAP_FAILED){
+				::sdci::detail::ioerr();
+			}
+			m_addr = addr;
+			m_size = st.st_size;
+
+			static const int advices[] = {MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED};
+			::madvise(m_addr, m_size, advices[options.advice]);
+
+#ifndef MAP_POPULATE
+			if(options.prefault){
+				const long page = ::sysconf(_SC_PAGESIZE);
+				volatile char sum = 0;
+				for(size_type i = 0; i < m_size; i += page){
+					sum += data()[i];
+				}
+			}
+#endif
+			if(options.lock && ::mlock(m_addr, m_size) != 0){
+				::munmap(m_addr, m_size);
+				throw std::runtime_error("mapped_file: mlock failed");
+			}
+		}
+
+		mapped_file::~mapped_file(){
+			// munmap also releases the lock of mlock
+			::munmap(m_addr, m_size);
+		}
+
+		file_mapping::file_mapping(const std::string &filename, bool create)
+		: m_filename(filename), m_fd(-1), m_addr(0), m_size(0)
+		{
+			m_fd = ::open(filename.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+			if(m_fd < 0){
+				::sdci::detail::ioerr();
+			}
+			struct stat st;
+			if(::fstat(m_fd, &st) != 0){
+				::close(m_fd);
+				::sdci::detail::ioerr();
+			}
+			if(st.st_size != 0){
+				m_addr = ::mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+				if(m_addr == MAP_FAILED){
+					::close(m_fd);
+					::sdci::detail::ioerr();
+				}
+				m_size = st.st_size;
+			}
+		}
+
+		file_mapping::~file_mapping(){
+			if(m_size != 0){
+				::munmap(m_addr, m_size);
+			}
+			::close(m_fd);
+		}
+
+		void file_mapping::resize(size_type size_){
+			if(size_ == m_size){
+				return;
+			}
+			if(::ftruncate(m_fd, size_) != 0){
+				::sdci::detail::ioerr();
+			}
+			void *addr = 0;
+			if(size_ != 0){
+#ifdef MREMAP_MAYMOVE
+				addr = m_size != 0
+					? ::mremap(m_addr, m_size, size_, MREMAP_MAYMOVE)
+					: ::mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+#else
+				addr = ::mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+				if(addr != MAP_FAILED && m_size != 0){
+					::munmap(m_addr, m_size);
+				}
+#endif
+				if(addr == MAP_FAILED){
+					::sdci::detail::ioerr();
+				}
+			}
+			else{
+				::munmap(m_addr, m_size);
+			}
+			m_addr = addr;
+			m_size = size_;
+		}
+
+		void file_mapping::sync(){
+			if(m_size != 0 && ::msync(m_addr, m_size, MS_SYNC) != 0){
+				::sdci::detail::ioerr();
+			}
+		}
+
+		void replace_file(const std::string &filename, const std::string &data){
+			const std::string tmpname = filename + ".tmp";
+			const int fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if(fd < 0){
+				::sdci::detail::ioerr();
+			}
+			const bool written =
+				::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && ::fsync(fd) == 0;
+			::close(fd);
+			if(!written || ::rename(tmpname.c_str(), filename.c_str()) != 0){
+				::sdci::detail::ioerr();
+			}
+
+			// the rename itself is made durable by syncing the directory
+			const std::string::size_type slash = filename.rfind('/');
+			const std::string dirname = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+			const int dirfd = ::open(dirname.c_str(), O_RDONLY);
+			if(dirfd >= 0){
+				::fsync(dirfd);
+				::close(dirfd);
+			}
+		}
+#else
+		mapped_file::mapped_file(const char *filename, const map_options &)
+		: m_addr(0), m_size(0)
+		{
+			std::ifstream stream(filename, std::ios_base::binary);
+			if(!stream.good()){
+				::sdci::detail::ioerr();
+			}
+			stream.seekg(0, std::ios_base::end);
+			m_size = static_cast<size_type>(stream.tellg());
+			stream.seekg(0, std::ios_base::beg);
+			if(m_size == 0){
+				::sdci::detail::formaterr();
+			}
+			// words keep the data aligned as in a mapping
+			m_copy.resize((m_size + sizeof(uint64_type) - 1) / sizeof(uint64_type));
+			::sdci::detail::read_data(stream, &m_copy[0], m_size);
+			m_addr = &m_copy[0];
+		}
+
+		mapped_file::~mapped_file(){
+		}
+
+		file_mapping::file_mapping(const std::string &filename, bool create)
+		: m_filename(filename), m_fd(-1), m_addr(0), m_size(0)
+		{
+			if(create){
+				std::ofstream stream(filename.c_str(), std::ios_base::binary);
+				if(!stream.good()){
+					::sdci::detail::ioerr();
+				}
+				return;
+			}
+			std::ifstream stream(filename.c_str(), std::ios_base::binary);
+			if(!stream.good()){
+				::sdci::detail::ioerr();
+			}
+			stream.seekg(0, std::ios_base::end);
+			const size_type size_ = static_cast<size_type>(stream.tellg());
+			stream.seekg(0, std::ios_base::beg);
+			resize(size_);
+			if(size_ != 0){
+				::sdci::detail::read_data(stream, data(), size_);
+			}
+		}
+
+		file_mapping::~file_mapping(){
+		}
+
+		void file_mapping::resize(size_type size_){
+			m_copy.resize((size_ + sizeof(uint64_type) - 1) / sizeof(uint64_type));
+			if(size_ > m_size){
+				std::memset(reinterpret_cast<char*>(&m_copy[0]) + m_size, 0, m_copy.size() * sizeof(uint64_type) - m_size);
+			}
+			m_addr = m_copy.empty() ? 0 : &m_copy[0];
+			m_size = size_;
+		}
+
+		void file_mapping::sync(){
+			std::string data_(static_cast<const char*>(m_addr), m_size);
+			replace_file(m_filename, data_);
+		}
+
+		void replace_file(const std::string &filename, const std::string &data){
+			const std::string tmpname = filename + ".tmp";
+			{
+				std::ofstream stream(tmpname.c_str(), std::ios_base::binary);
+				::sdci::detail::write_data(stream, data.data(), data.size());
+				stream.flush();
+				if(!stream.good()){
+					::sdci::detail::ioerr();
+				}
+			}
+			std::remove(filename.c_str());
+			if(std::rename(tmpname.c_str(), filename.c_str()) != 0){
+				::sdci::detail::ioerr();
+			}
+		}
+#endif
+
+		namespace{
+			// malloc may take large blocks from its heap, where calloc() has to clear them
+			const size_type zeroed_map_threshold = size_type(1) << 20;
+
+			const size_type lg_huge_page_2m = 21;
+			const size_type lg_huge_page_1g = 30;
+
+			// The policy, and the blocks mapped by allocate_zeroed.
+			struct memory_state{
+				std::mutex mutex;
+				memory_options options;
+#ifdef SDCI_USE_MMAP
+				std::map<void*, size_type> blocks;	// the lengths of the mappings of the blocks in use
+				std::multimap<size_type, void*> arena;	// the released blocks kept for reuse, by the lengths
+				size_type arena_bytes;
+
+				memory_state()
+				: arena_bytes(0)
+				{
+				}
+#endif
+			};
+
+			// never destroyed, since indexes with static storage may release their blocks after it
+			memory_state& memory(){
+				static memory_state *state = new memory_state;
+				return *state;
+			}
+
+#ifdef SDCI_USE_MMAP
+			size_type round_up(size_type bytes, size_type unit){
+				return (bytes + unit - 1) / unit * unit;
+			}
+
+			// Releases the blocks kept for reuse until they take at most limit bytes, from the longest one.
+			void trim_arena(memory_state &state, size_type limit){
+				while(state.arena_bytes > limit){
+					std::multimap<size_type, void*>::iterator it = state.arena.end();
+					--it;
+					::munmap(it->second, it->first);
+					state.arena_bytes -= it->first;
+					state.arena.erase(it);
+				}
+			}
+
+			/*
+				Writes 0 to each page of the bytes at addr, or all of them if clear is true,
+				with the threads (or all hardware threads if it is 0).
+				Each thread takes whole huge pages, so that a huge page is faulted by one thread.
+			*/
+			void touch_pages(char *addr, size_type bytes, bool clear, unsigned num_threads){
+				if(num_threads == 0){
+					num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+				}
+				const size_type page = ::sysconf(_SC_PAGESIZE);
+				const size_type chunk = round_up((bytes + num_threads - 1) / num_threads, size_type(1) << lg_huge_page_2m);
+				struct toucher{
+					static void run(char *first, char *last, bool clear, size_type page){
+						if(clear){
+							std::memset(first, 0, last - first);
+							return;
+						}
+						for(volatile char *p = first; p < last; p += page){
+							*p = 0;
+						}
+					}
+				};
+
+				std::vector<std::thread> threads;
+				size_type begin = 0;
+				for(; begin + chunk < bytes; begin += chunk){
+					try{
+						threads.push_back(std::thread(&toucher::run, addr + begin, addr + begin + chunk, clear, page));
+					}
+					catch(...){
+						// the pages of the thread not started are touched by this thread
+						toucher::run(addr + begin, addr + begin + chunk, clear, page);
+					}
+				}
+				toucher::run(addr + begin, addr + bytes, clear, page);
+				for(size_type i = 0; i < threads.size(); ++i){
+					threads[i].join();
+				}
+			}
+
+			// Maps a block of bytes with the pages of the options, and sets length to the length of the mapping.
+			void* map_block(size_type bytes, const memory_options &options, size_type &length){
+				const int prot = PROT_READ | PROT_WRITE;
+				const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+				if(options.pages == memory_options::pages_huge_2m || options.pages == memory_options::pages_huge_1g){
+					const size_type lg_huge_page =
+						options.pages == memory_options::pages_huge_1g ? lg_huge_page_1g : lg_huge_page_2m;
+					if(bytes >= size_type(1) << lg_huge_page){
+						length = round_up(bytes, size_type(1) << lg_huge_page);
+						void *addr = ::mmap(0, length, prot, flags | MAP_HUGETLB | int(lg_huge_page << MAP_HUGE_SHIFT), -1, 0);
+						if(addr != MAP_FAILED){
+							return addr;
+						}
+					}
+				}
+#endif
+				const size_type huge_page = size_type(1) << lg_huge_page_2m;
+				if(options.pages != memory_options::pages_normal && bytes >= huge_page){
+					// maps a huge page more, and unmaps the parts out of the aligned block
+					length = round_up(bytes, huge_page);
+					void *addr = ::mmap(0, length + huge_page, prot, flags, -1, 0);
+					if(addr == MAP_FAILED){
+						throw std::bad_alloc();
+					}
+					const size_type head = (huge_page - reinterpret_cast<uintptr_t>(addr) % huge_page) % huge_page;
+					char *aligned = static_cast<char*>(addr) + head;
+					if(head != 0){
+						::munmap(addr, head);
+					}
+					::munmap(aligned + length, huge_page - head);
+#ifdef MADV_HUGEPAGE
+					::madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+					return aligned;
+				}
+				length = round_up(bytes, ::sysconf(_SC_PAGESIZE));
+				void *addr = ::mmap(0, length, prot, flags, -1, 0);
+				if(addr == MAP_FAILED){
+					throw std::bad_alloc();
+				}
+				return addr;
+			}
+#endif
+		}
+
+		void* allocate_zeroed(size_type bytes){
+#ifdef SDCI_USE_MMAP
+			if(bytes >= zeroed_map_threshold){
+				memory_state &state = memory();
+				memory_options options;
+				void *addr = 0;
+				size_type length = 0;
+				{
+					std::lock_guard<std::mutex> lock(state.mutex);
+					options = state.options;
+					// the shortest block kept which is long enough, unless a quarter of it would be wasted
+					std::multimap<size_type, void*>::iterator it = state.arena.lower_bound(bytes);
+					if(it != state.arena.end() && it->first - bytes <= bytes / 4){
+						addr = it->second;
+						length = it->first;
+						state.arena_bytes -= length;
+						state.arena.erase(it);
+					}
+				}
+				const bool reused = addr != 0;
+				if(!reused){
+					addr = map_block(bytes, options, length);
+				}
+				try{
+					std::lock_guard<std::mutex> lock(state.mutex);
+					state.blocks.insert(std::make_pair(addr, length));
+				}
+				catch(...){
+					::munmap(addr, length);
+					throw;
+				}
+				if(reused){
+					touch_pages(static_cast<char*>(addr), bytes, true, options.prefault_threads);
+				}
+				else if(options.prefault){
+					touch_pages(static_cast<char*>(addr), bytes, false, options.prefault_threads);
+				}
+				return addr;
+			}
+#endif
+			void *ptr = std::calloc(std::max<size_type>(bytes, 1), 1);
+			if(ptr == 0){
+				throw std::bad_alloc();
+			}
+			return ptr;
+		}
+
+		void deallocate_zeroed(void *ptr, size_type bytes){
+#ifdef SDCI_USE_MMAP
+			if(bytes >= zeroed_map_threshold){
+				memory_state &state = memory();
+				size_type length = bytes;
+				{
+					std::lock_guard<std::mutex> lock(state.mutex);
+					std::map<void*, size_type>::iterator it = state.blocks.find(ptr);
+					if(it != state.blocks.end()){
+						length = it->second;
+						state.blocks.erase(it);
+					}
+					if(length <= state.options.arena_bytes){
+						try{
+							state.arena.insert(std::make_pair(length, ptr));
+							state.arena_bytes += length;
+							trim_arena(state, state.options.arena_bytes);
+							return;
+						}
+						catch(...){
+						}
+					}
+				}
+				::munmap(ptr, length);
+				return;
+			}
+#else
+			static_cast<void>(bytes);
+#endif
+			std::free(ptr);
+		}
+	
+		block_reader::block_reader(int fd, size_type block_size)
+		: m_fd(fd), m_file(0), m_owns_fd(false), m_block_size(std::max<size_type>(block_size, 1)), m_expected_size(0),
+		  m_front(0), m_read_size(0)
+		{
+#ifdef SDCI_USE_MMAP
+			struct stat st;
+			const off_t offset = ::lseek(m_fd, 0, SEEK_CUR);
+			if(::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset){
+				m_expected_size = st.st_size - offset;
+			}
+			m_buf[0].resize(m_block_size);
+			m_buf[1].resize(m_block_size);
+			start_reading();
+#else
+			throw std::runtime_error("block_reader: file descriptors are not supported");
+#endif
+		}
+
+		block_reader::block_reader(const char *filename, size_type block_size)
+		: m_fd(-1), m_file(0), m_owns_fd(true), m_block_size(std::max<size_type>(block_size, 1)), m_expected_size(0),
+		  m_front(0), m_read_size(0)
+		{
+#ifdef SDCI_USE_MMAP
+			m_fd = ::open(filename, O_RDONLY);
+			if(m_fd < 0){
+				::sdci::detail::ioerr();
+			}
+			struct stat st;
+			if(::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)){
+				m_expected_size = st.st_size;
+			}
+#else
+			m_file = std::fopen(filename, "rb");
+			if(m_file == 0){
+				::sdci::detail::ioerr();
+			}
+			if(std::fseek(m_file, 0, SEEK_END) == 0){
+				const long end = std::ftell(m_file);
+				m_expected_size = end > 0 ? end : 0;
+			}
+			std::rewind(m_file);
+#endif
+			try{
+				m_buf[0].resize(m_block_size);
+				m_buf[1].resize(m_block_size);
+				start_reading();
+			}
+			catch(...){
+				close_file();
+				throw;
+			}
+		}
+
+		block_reader::~block_reader(){
+			if(m_thread.joinable()){
+				m_thread.join();
+			}
+			close_file();
+		}
+
+		void block_reader::close_file(){
+#ifdef SDCI_USE_MMAP
+			if(m_owns_fd && m_fd >= 0){
+				::close(m_fd);
+				m_fd = -1;
+			}
+#endif
+			if(m_file != 0){
+				std::fclose(m_file);
+				m_file = 0;
+			}
+		}
+
+		// The next block is read into the back buffer.
+		void block_reader::start_reading(){
+			char *const buf = &m_buf[1 - m_front][0];
+			m_thread = std::thread([this, buf](){
+				try{
+					m_read_size = read_block(buf);
+				}
+				catch(...){
+					m_error = std::current_exception();
+				}
+			});
+		}
+
+		// Fills buf unless the end of the file is reached.
+		block_reader::size_type block_reader::read_block(char *buf){
+			size_type filled = 0;
+			while(filled < m_block_size){
+#ifdef SDCI_USE_MMAP
+				const ssize_t r = ::read(m_fd, buf + filled, m_block_size - filled);
+				if(r < 0 && errno == EINTR){
+					continue;
+				}
+				if(r < 0){
+					::sdci::detail::ioerr();
+				}
+#else
+				const size_type r = std::fread(buf + filled, 1, m_block_size - filled, m_file);
+				if(std::ferror(m_file)){
+					::sdci::detail::ioerr();
+				}
+#endif
+				if(r == 0){
+					break;
+				}
+				filled += r;
+			}
+			return filled;
+		}
+
+		bool block_reader::next(const char *&data, size_type &size){
+			if(!m_thread.joinable()){
+				return false;
+			}
+			m_thread.join();
+			if(m_error){
+				std::rethrow_exception(m_error);
+			}
+			if(m_read_size == 0){
+				return false;
+			}
+			m_front = 1 - m_front;
+			data = &m_buf[m_front][0];
+			size = m_read_size;
+			// a short block is the last one
+			if(m_read_size == m_block_size){
+				start_reading();
+			}
+			return true;
+		}
+	}
+
+	void set_memory_options(const memory_options &options){
+		::sdci::detail::memory_state &state = ::sdci::detail::memory();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.options = options;
+#ifdef SDCI_USE_MMAP
+		::sdci::detail::trim_arena(state, options.arena_bytes);
+#endif
+	}
+
+	memory_options get_memory_options(){
+		::sdci::detail::memory_state &state = ::sdci::detail::memory();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		return state.options;
+	}
+
+	void release_memory_arena(){
+#ifdef SDCI_USE_MMAP
+		::sdci::detail::memory_state &state = ::sdci::detail::memory();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		::sdci::detail::trim_arena(state, 0);
+#endif
+	}
+}
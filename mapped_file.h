@@ -0,0 +1,288 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SDCI_MAPPED_FILE_H_INCLUDED
+#define SDCI_MAPPED_FILE_H_INCLUDED
+
+#include "sdci_common.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <thread>
+#include <exception>
+
+namespace sdci{
+	/*
+		Options of semidynamic_compact_index::map_file().
+	*/
+	struct map_options{
+		enum advice_type{ advice_normal, advice_random, advice_sequential, advice_willneed };
+
+		/*
+			The expected access pattern, which is passed to madvise().
+			Queries access the index randomly, so advice_random avoids useless read-ahead,
+			while advice_willneed starts reading the whole file in background.
+		*/
+		advice_type advice;
+
+		/*
+			Whether all pages are read when the file is mapped,
+			so that no query waits for page faults.
+		*/
+		bool prefault;
+
+		/*
+			Whether the pages are locked in memory with mlock(),
+			so that they are never paged out.
+			This may fail due to RLIMIT_MEMLOCK.
+		*/
+		bool lock;
+
+		map_options()
+		: advice(advice_normal), prefault(false), lock(false)
+		{
+		}
+	};
+
+	/*
+		The policy of the memory of the large buffers of all indexes
+		(the arrays of the q-grams, the position lists and the sets),
+		which are blocks of at least 1 MiB allocated by detail::allocate_zeroed.
+		It is ignored where mmap() is not available.
+	*/
+	struct memory_options{
+		enum page_type{ pages_normal, pages_transparent_huge, pages_huge_2m, pages_huge_1g };
+
+		/*
+			The pages of the blocks.
+			pages_transparent_huge aligns the blocks to 2 MiB and asks for transparent huge pages
+			with madvise(MADV_HUGEPAGE), so that random accesses miss the TLB less often.
+			pages_huge_2m and pages_huge_1g map the blocks with MAP_HUGETLB from the pages reserved by the system
+			(e.g. /sys/kernel/mm/hugepages), and fall back to transparent huge pages if no page is available.
+			Huge pages are used only for the blocks of at least one huge page.
+		*/
+		page_type pages;
+
+		/*
+			Whether the pages of a block are touched when the block is allocated,
+			by prefault_threads threads (or all hardware threads if it is 0),
+			so that the pages are spread over the NUMA nodes of the threads
+			and no query or append waits for page faults.
+		*/
+		bool prefault;
+		unsigned prefault_threads;
+
+		/*
+			The maximum number of bytes of the released blocks kept for reuse,
+			so that an index rebuilt with similar parameters takes its blocks again
+			without mapping and faulting the pages.
+			A reused block is cleared with the threads of prefault.
+		*/
+		::sdci::detail::size_type arena_bytes;
+
+		memory_options()
+		: pages(pages_normal), prefault(false), prefault_threads(0), arena_bytes(0)
+		{
+		}
+	};
+
+	/*
+		Sets the policy of the blocks allocated after this call.
+		The blocks already allocated keep their pages,
+		and the blocks kept for reuse beyond the new arena_bytes are released.
+	*/
+	void set_memory_options(const memory_options &options);
+	memory_options get_memory_options();
+
+	/*
+		Releases all the blocks kept for reuse.
+	*/
+	void release_memory_arena();
+
+	namespace detail{
+		/*
+			A read-only mapping of a whole file.
+			Where mmap() is not available (or SDCI_NO_USE_MMAP is defined),
+			the file is read into memory instead.
+		*/
+		class mapped_file{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+
+			mapped_file(const char *filename, const map_options &options);
+			~mapped_file();
+
+			const char* data() const;
+			size_type size() const;
+
+#if __cplusplus >= 201103L
+			mapped_file(const mapped_file &) = delete;
+			mapped_file& operator= (const mapped_file &) = delete;
+#endif
+
+		private:
+			void *m_addr;
+			size_type m_size;
+			std::vector<uint64_type> m_copy;
+		};
+
+		/*
+			A writable shared mapping of a whole file, whose size can be changed.
+			The modifications of the mapped memory are written to the file.
+			Where mmap() is not available (or SDCI_NO_USE_MMAP is defined),
+			the data is kept in memory and written to the file by sync().
+		*/
+		class file_mapping{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+
+			/*
+				Opens the file, or creates it if create is true.
+			*/
+			file_mapping(const std::string &filename, bool create);
+			~file_mapping();
+
+			char* data();
+			size_type size() const;
+
+			/*
+				Changes the size of the file.
+				The bytes after the old size are 0, and the data may move.
+			*/
+			void resize(size_type size);
+
+			/*
+				Waits until the data is written to the storage.
+			*/
+			void sync();
+
+#if __cplusplus >= 201103L
+			file_mapping(const file_mapping &) = delete;
+			file_mapping& operator= (const file_mapping &) = delete;
+#endif
+
+		private:
+			std::string m_filename;
+			int m_fd;
+			void *m_addr;
+			size_type m_size;
+			std::vector<uint64_type> m_copy;
+		};
+
+		/*
+			Replaces the content of the file with data atomically,
+			i.e. the file has either the old content or the new one even after a crash.
+		*/
+		void replace_file(const std::string &filename, const std::string &data);
+
+		/*
+			Allocates a zero-filled block of bytes, which must be released by deallocate_zeroed with the same size.
+			Large blocks are mapped anonymously and their pages are zeroed by the OS when touched,
+			so that the allocation takes a time independent of the size
+			(unless memory_options asks for prefaulting or a block is reused).
+			Small blocks (and all blocks where mmap() is not available) are allocated by calloc().
+		*/
+		void* allocate_zeroed(::sdci::detail::size_type bytes);
+		void deallocate_zeroed(void *ptr, ::sdci::detail::size_type bytes);
+
+		/*
+			Reads a file sequentially in blocks.
+			While a block is processed, the next block is read by a background thread.
+			Where POSIX read() is not available, file descriptors are not supported.
+		*/
+		class block_reader{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+
+			/*
+				Reads the file descriptor from its current offset. The descriptor is not closed.
+			*/
+			block_reader(int fd, size_type block_size);
+
+			/*
+				Opens and reads the file.
+			*/
+			block_reader(const char *filename, size_type block_size);
+			~block_reader();
+
+			/*
+				Returns the number of bytes to be read if it is known (i.e. for a regular file), or 0.
+			*/
+			size_type expected_size() const;
+
+			/*
+				Gets the next block, which is valid until the next call.
+				Returns false at the end of the file.
+			*/
+			bool next(const char *&data, size_type &size);
+
+#if __cplusplus >= 201103L
+			block_reader(const block_reader &) = delete;
+			block_reader& operator= (const block_reader &) = delete;
+#endif
+
+		private:
+			void start_reading();
+			size_type read_block(char *buf);
+			void close_file();
+
+			int m_fd;
+			std::FILE *m_file;
+			bool m_owns_fd;
+			size_type m_block_size;
+			size_type m_expected_size;
+			std::vector<char> m_buf[2];
+			size_type m_front;
+			size_type m_read_size;
+			std::exception_ptr m_error;
+			std::thread m_thread;
+		};
+
+		inline const char*
+		mapped_file::data() const{
+			return static_cast<const char*>(m_addr);
+		}
+
+		inline mapped_file::size_type
+		mapped_file::size() const{
+			return m_size;
+		}
+
+		inline block_reader::size_type
+		block_reader::expected_size() const{
+			return m_expected_size;
+		}
+
+		inline char*
+		file_mapping::data(){
+			return static_cast<char*>(m_addr);
+		}
+
+		inline file_mapping::size_type
+		file_mapping::size() const{
+			return m_size;
+		}
+	}
+}
+
+#endif
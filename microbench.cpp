@@ -0,0 +1,530 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Microbenchmark of the building blocks of semidynamic_compact_index.
+
+	Usage: sdci_microbench [--ops N] [--max-lg L] [--max-elements M] [--memory-bytes B] [--seed S] [--out FILE]
+
+	This program measures the time per operation (in ns) of
+	- packed_array::get/set/get_range for each bit width 1..64,
+	  and get_fixed/set_fixed for the widths of the edges of typical alphabets and the widths dividing 64,
+	- integer_set::insert/successor/predecessor on sparse and dense sets
+	  whose universes are 2^10..2^L,
+	- sampled_position_list::insert_first/first_node/next_node,
+	  including the growth through reserve and the incremental growth,
+	- packed_array::get on an array of B bytes for each page policy of sdci::memory_options,
+	  with the dTLB load misses per get (where perf_event_open() is available),
+	  the allocation time with prefaulting and the time to allocate the array again from the arena,
+	with sequential and random access patterns, and writes the results in JSON.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "sdci_common.h"
+#include "mapped_file.h"
+#include "packed_array.h"
+#include "integer_set.h"
+#include "sampled_position_list.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace{
+	typedef std::size_t size_type;
+	typedef std::chrono::steady_clock clock_type;
+	typedef std::mt19937_64 random_engine;
+
+	struct bench_options{
+		size_type num_ops;
+		size_type max_lg_universe;
+		size_type max_elements;
+		size_type memory_bytes;
+		unsigned long long seed;
+		std::string output;
+	};
+
+	volatile size_type sink;
+
+	double ns_per_op(clock_type::time_point start, size_type ops){
+		const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+		return ops ? ns / ops : 0;
+	}
+
+	// Positions 0, 1, ..., or uniformly random positions in [0, size).
+	void make_positions(size_type size, size_type ops, bool random, random_engine &rng,
+	                    std::vector<size_type> &pos){
+		pos.resize(ops);
+		std::uniform_int_distribution<size_type> dist(0, size - 1);
+		for(size_type i = 0; i < ops; ++i){
+			pos[i] = random ? dist(rng) : i % size;
+		}
+	}
+
+	template <size_type BitWidth>
+	void time_fixed_width(
+		::sdci::detail::packed_array &pa, const std::vector<size_type> &pos, double &set_ns, double &get_ns
+	){
+		typedef ::sdci::detail::packed_array::value_type value_type;
+		const value_type mask = value_type(-1) >> (64 - BitWidth);
+		clock_type::time_point start = clock_type::now();
+		for(size_type i = 0; i < pos.size(); ++i){
+			pa.set_fixed<BitWidth>(pos[i], i & mask);
+		}
+		set_ns = ns_per_op(start, pos.size());
+
+		size_type sum = 0;
+		start = clock_type::now();
+		for(size_type i = 0; i < pos.size(); ++i){
+			sum += pa.get_fixed<BitWidth>(pos[i]);
+		}
+		get_ns = ns_per_op(start, pos.size());
+		sink = sum;
+	}
+
+	// The widths of the edges for sigma = 1, 2..3, 4..7, 20 and 256 (as in static_semidynamic_compact_index),
+	// and the widths dividing 64. Returns false for the other widths.
+	bool time_fixed(::sdci::detail::packed_array &pa, const std::vector<size_type> &pos, double &set_ns, double &get_ns){
+		switch(pa.bit_width()){
+		case 1: time_fixed_width<1>(pa, pos, set_ns, get_ns); return true;
+		case 2: time_fixed_width<2>(pa, pos, set_ns, get_ns); return true;
+		case 3: time_fixed_width<3>(pa, pos, set_ns, get_ns); return true;
+		case 4: time_fixed_width<4>(pa, pos, set_ns, get_ns); return true;
+		case 5: time_fixed_width<5>(pa, pos, set_ns, get_ns); return true;
+		case 8: time_fixed_width<8>(pa, pos, set_ns, get_ns); return true;
+		case 9: time_fixed_width<9>(pa, pos, set_ns, get_ns); return true;
+		case 16: time_fixed_width<16>(pa, pos, set_ns, get_ns); return true;
+		case 32: time_fixed_width<32>(pa, pos, set_ns, get_ns); return true;
+		case 64: time_fixed_width<64>(pa, pos, set_ns, get_ns); return true;
+		default: return false;
+		}
+	}
+
+	void bench_packed_array(std::ostream &out, const bench_options &opt, random_engine &rng){
+		using ::sdci::detail::packed_array;
+		const size_type size = opt.num_ops;
+		std::vector<size_type> pos;
+
+		out << "  \"packed_array\": [\n";
+		for(size_type width = 1; width <= packed_array::max_bit_width(); ++width){
+			packed_array pa(width, size);
+			pa.fill1(); // the pages are touched before the timing, so that the first pass does not pay the faults
+			const packed_array::value_type mask =
+				width == 64 ? packed_array::value_type(-1) : (packed_array::value_type(1) << width) - 1;
+			out << "    {\"bit_width\": " << width;
+			for(int random = 0; random < 2; ++random){
+				make_positions(size, opt.num_ops, random != 0, rng, pos);
+
+				clock_type::time_point start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					pa.set(pos[i], i & mask);
+				}
+				const double set_ns = ns_per_op(start, pos.size());
+
+				size_type sum = 0;
+				start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					sum += pa.get(pos[i]);
+				}
+				const double get_ns = ns_per_op(start, pos.size());
+				sink = sum;
+
+				const char *pattern = random ? "random" : "sequential";
+				out << ", \"" << pattern << "_set_ns\": " << set_ns
+				    << ", \"" << pattern << "_get_ns\": " << get_ns;
+
+				double set_fixed_ns = 0, get_fixed_ns = 0;
+				if(time_fixed(pa, pos, set_fixed_ns, get_fixed_ns)){
+					out << ", \"" << pattern << "_set_fixed_ns\": " << set_fixed_ns
+					    << ", \"" << pattern << "_get_fixed_ns\": " << get_fixed_ns;
+				}
+			}
+
+			// sequential scan decoded in blocks
+			std::vector<packed_array::value_type> block(4096);
+			size_type sum = 0;
+			const clock_type::time_point start = clock_type::now();
+			for(size_type i = 0; i < size; i += block.size()){
+				const size_type count = std::min(block.size(), size - i);
+				pa.get_range(i, count, block.data());
+				for(size_type j = 0; j < count; ++j){
+					sum += block[j];
+				}
+			}
+			sink = sum;
+			out << ", \"get_range_ns\": " << ns_per_op(start, size);
+			out << "}" << (width < packed_array::max_bit_width() ? "," : "") << "\n";
+		}
+		out << "  ],\n";
+	}
+
+	void bench_integer_set(std::ostream &out, const bench_options &opt, random_engine &rng){
+		using ::sdci::detail::integer_set;
+		typedef integer_set::value_type value_type;
+		static const struct{ const char *name; size_type inverse_density; } densities[] = {
+			{"sparse", 4096}, {"dense", 2},
+		};
+
+		out << "  \"integer_set\": [\n";
+		bool first = true;
+		for(size_type lg = 10; lg <= opt.max_lg_universe; lg += 2){
+			const size_type universe = size_type(1) << lg;
+			for(size_type d = 0; d < 2; ++d){
+				size_type num_elements = std::max<size_type>(1, universe / densities[d].inverse_density);
+				const bool capped = num_elements > opt.max_elements;
+				num_elements = std::min(num_elements, opt.max_elements);
+
+				integer_set set(universe);
+				std::vector<size_type> pos;
+				make_positions(universe, num_elements, true, rng, pos);
+				clock_type::time_point start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					set.insert(value_type(pos[i]));
+				}
+				const double insert_ns = ns_per_op(start, pos.size());
+
+				make_positions(universe, opt.num_ops, true, rng, pos);
+				size_type sum = 0;
+				start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					sum += set.successor(value_type(pos[i]));
+				}
+				const double random_succ_ns = ns_per_op(start, pos.size());
+
+				start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					sum += set.predecessor(value_type(pos[i]));
+				}
+				const double random_pred_ns = ns_per_op(start, pos.size());
+
+				// enumeration by repeated successor calls
+				size_type num_enum = 0;
+				start = clock_type::now();
+				for(value_type p = set.successor(-1);
+					size_type(p) < universe && num_enum < opt.num_ops;
+					p = set.successor(p)
+				){
+					++num_enum;
+				}
+				const double seq_succ_ns = ns_per_op(start, num_enum);
+				sink = sum + num_enum;
+
+				out << (first ? "" : ",\n")
+				    << "    {\"lg_universe\": " << lg << ", \"density\": \"" << densities[d].name
+				    << "\", \"elements\": " << set.size() << ", \"capped\": " << (capped ? "true" : "false")
+				    << ", \"insert_ns\": " << insert_ns
+				    << ", \"random_successor_ns\": " << random_succ_ns
+				    << ", \"random_predecessor_ns\": " << random_pred_ns
+				    << ", \"sequential_successor_ns\": " << seq_succ_ns
+				    << ", \"heap_bytes\": " << set.heap_usage() << "}";
+				first = false;
+			}
+		}
+		out << "\n  ],\n";
+	}
+
+	void bench_sampled_position_list(std::ostream &out, const bench_options &opt, random_engine &rng){
+		using ::sdci::detail::sampled_position_list;
+		static const size_type entry_numbers[] = {size_type(1) << 8, size_type(1) << 16, size_type(1) << 24};
+
+		out << "  \"sampled_position_list\": [\n";
+		for(size_type e = 0; e < 3; ++e){
+			const size_type entries = entry_numbers[e];
+			std::vector<size_type> inserted;
+			make_positions(entries, opt.num_ops, true, rng, inserted);
+			const std::vector<size_type> &pos = inserted;
+
+			// growth through reserve is included; the slowest insertion shows its stall
+			sampled_position_list list(entries);
+			double max_insert_ns = 0;
+			clock_type::time_point start = clock_type::now();
+			for(size_type i = 0; i < pos.size(); ++i){
+				const clock_type::time_point t = clock_type::now();
+				list.insert_first(pos[i]);
+				max_insert_ns = std::max(max_insert_ns, ns_per_op(t, 1));
+			}
+			const double insert_ns = ns_per_op(start, pos.size());
+
+			sampled_position_list incremental(entries);
+			incremental.set_incremental_growth(true);
+			double max_incremental_ns = 0;
+			start = clock_type::now();
+			for(size_type i = 0; i < pos.size(); ++i){
+				const clock_type::time_point t = clock_type::now();
+				incremental.insert_first(pos[i]);
+				max_incremental_ns = std::max(max_incremental_ns, ns_per_op(t, 1));
+			}
+			const double incremental_ns = ns_per_op(start, pos.size());
+
+			sampled_position_list reserved(entries, pos.size());
+			start = clock_type::now();
+			for(size_type i = 0; i < pos.size(); ++i){
+				reserved.insert_first(pos[i]);
+			}
+			const double reserved_insert_ns = ns_per_op(start, pos.size());
+
+			size_type sum = 0;
+			std::vector<size_type> lookup;
+			make_positions(entries, opt.num_ops, true, rng, lookup);
+			start = clock_type::now();
+			for(size_type i = 0; i < lookup.size(); ++i){
+				sum += list.first_node(lookup[i]);
+			}
+			const double first_ns = ns_per_op(start, lookup.size());
+
+			// walk whole non-empty lists, as locate does
+			size_type num_next = 0;
+			start = clock_type::now();
+			for(size_type i = 0; i < inserted.size() && num_next < opt.num_ops; ++i){
+				for(size_type nd = list.first_node(inserted[i]);
+					nd != sampled_position_list::npos;
+					nd = list.next_node(nd)
+				){
+					sum += nd;
+					++num_next;
+				}
+			}
+			const double next_ns = ns_per_op(start, num_next);
+			sink = sum;
+
+			out << "    {\"entries\": " << entries << ", \"nodes\": " << list.node_size()
+			    << ", \"insert_first_ns\": " << insert_ns
+			    << ", \"max_insert_first_ns\": " << max_insert_ns
+			    << ", \"incremental_insert_first_ns\": " << incremental_ns
+			    << ", \"max_incremental_insert_first_ns\": " << max_incremental_ns
+			    << ", \"reserved_insert_first_ns\": " << reserved_insert_ns
+			    << ", \"random_first_node_ns\": " << first_ns
+			    << ", \"list_walk_ns_per_node\": " << next_ns
+			    << ", \"heap_bytes\": " << list.heap_usage() << "}"
+			    << (e < 2 ? "," : "") << "\n";
+		}
+		out << "  ]\n";
+	}
+
+	// Counts the dTLB load misses of this thread, or nothing where perf_event_open() is not available.
+	class tlb_miss_counter{
+	public:
+		tlb_miss_counter()
+		: m_fd(-1)
+		{
+#ifdef __linux__
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			m_fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+		}
+
+		~tlb_miss_counter(){
+#ifdef __linux__
+			if(m_fd >= 0){
+				::close(m_fd);
+			}
+#endif
+		}
+
+		bool available() const{
+			return m_fd >= 0;
+		}
+
+		void start(){
+#ifdef __linux__
+			if(m_fd >= 0){
+				::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+				::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+		}
+
+		unsigned long long stop(){
+			unsigned long long count = 0;
+#ifdef __linux__
+			if(m_fd >= 0){
+				::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+				if(::read(m_fd, &count, sizeof(count)) != sizeof(count)){
+					count = 0;
+				}
+			}
+#endif
+			return count;
+		}
+
+	private:
+		int m_fd;
+	};
+
+	void bench_memory_options(std::ostream &out, const bench_options &opt, random_engine &rng){
+		using ::sdci::detail::packed_array;
+		static const struct{
+			const char *name;
+			::sdci::memory_options::page_type pages;
+		} policies[] = {
+			{"normal", ::sdci::memory_options::pages_normal},
+			{"transparent_huge", ::sdci::memory_options::pages_transparent_huge},
+			{"huge_2m", ::sdci::memory_options::pages_huge_2m},
+			{"huge_1g", ::sdci::memory_options::pages_huge_1g},
+		};
+		const size_type width = 32;
+		const size_type size = opt.memory_bytes * 8 / width;
+		std::vector<size_type> pos;
+		make_positions(size, opt.num_ops, true, rng, pos);
+		tlb_miss_counter counter;
+		const ::sdci::memory_options saved = ::sdci::get_memory_options();
+
+		out << "  \"memory_options\": {\"bytes\": " << opt.memory_bytes
+		    << ", \"threads\": " << std::thread::hardware_concurrency()
+		    << ", \"tlb_counter\": " << (counter.available() ? "true" : "false") << ", \"pages\": [\n";
+		const size_type num_policies = sizeof(policies) / sizeof(policies[0]);
+		for(size_type p = 0; p < num_policies; ++p){
+			::sdci::memory_options options;
+			options.pages = policies[p].pages;
+			options.prefault = true;
+			options.arena_bytes = opt.memory_bytes * 2;
+			::sdci::set_memory_options(options);
+
+			clock_type::time_point start = clock_type::now();
+			double alloc_ms = 0;
+			double get_ns = 0;
+			double misses = 0;
+			{
+				packed_array pa(width, size);
+				alloc_ms = ns_per_op(start, 1) / 1e6;
+				for(size_type i = 0; i < size; i += 4096){
+					pa.set(i, i);
+				}
+
+				size_type sum = 0;
+				counter.start();
+				start = clock_type::now();
+				for(size_type i = 0; i < pos.size(); ++i){
+					sum += pa.get(pos[i]);
+				}
+				get_ns = ns_per_op(start, pos.size());
+				misses = double(counter.stop()) / pos.size();
+				sink = sum;
+			}
+
+			// the array released above is kept in the arena
+			start = clock_type::now();
+			{
+				packed_array pa(width, size);
+				sink = pa.get(size - 1);
+			}
+			const double arena_alloc_ms = ns_per_op(start, 1) / 1e6;
+			::sdci::release_memory_arena();
+
+			out << "    {\"pages\": \"" << policies[p].name << "\""
+			    << ", \"prefault_alloc_ms\": " << alloc_ms
+			    << ", \"arena_alloc_ms\": " << arena_alloc_ms
+			    << ", \"random_get_ns\": " << get_ns;
+			if(counter.available()){
+				out << ", \"dtlb_misses_per_get\": " << misses;
+			}
+			out << "}" << (p + 1 < num_policies ? "," : "") << "\n";
+		}
+		out << "  ]},\n";
+		::sdci::set_memory_options(saved);
+	}
+
+	void usage(){
+		std::cerr << "Usage: sdci_microbench [--ops N] [--max-lg L] [--max-elements M] [--memory-bytes B] [--seed S] [--out FILE]"
+		          << std::endl;
+		std::exit(1);
+	}
+}
+
+int main(int argc, char **argv){
+	bench_options opt;
+	opt.num_ops = 1 << 22;
+	opt.max_lg_universe = 30;
+	opt.max_elements = 1 << 24;
+	opt.memory_bytes = size_type(1) << 30;
+	opt.seed = 1;
+
+	for(int i = 1; i < argc; ++i){
+		if(i + 1 >= argc){
+			usage();
+		}
+		if(std::strcmp(argv[i], "--ops") == 0){
+			opt.num_ops = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--max-lg") == 0){
+			opt.max_lg_universe = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--max-elements") == 0){
+			opt.max_elements = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--memory-bytes") == 0){
+			opt.memory_bytes = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--seed") == 0){
+			opt.seed = std::strtoull(argv[++i], 0, 10);
+		}
+		else if(std::strcmp(argv[i], "--out") == 0){
+			opt.output = argv[++i];
+		}
+		else{
+			usage();
+		}
+	}
+	if(opt.num_ops == 0 || opt.max_elements == 0 || opt.max_lg_universe > 34 || opt.memory_bytes < 8){
+		usage();
+	}
+
+	std::ofstream file;
+	if(!opt.output.empty()){
+		file.open(opt.output.c_str());
+		if(!file.good()){
+			std::cerr << "sdci_microbench: cannot open " << opt.output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream &out = opt.output.empty() ? std::cout : file;
+	random_engine rng(opt.seed);
+
+	out << "{\n"
+	    << "  \"benchmark\": \"sdci_primitives\",\n"
+	    << "  \"ops\": " << opt.num_ops << ",\n"
+	    << "  \"seed\": " << opt.seed << ",\n";
+	bench_packed_array(out, opt, rng);
+	bench_integer_set(out, opt, rng);
+	bench_memory_options(out, opt, rng);
+	bench_sampled_position_list(out, opt, rng);
+	out << "}\n";
+}
@@ -22,6 +22,7 @@
 #include "packed_array.h"
 #include <stdexcept>
 #include <limits>
+#include <thread>
 
 namespace sdci{
 	namespace detail{
@@ -31,47 +32,79 @@ namespace sdci{
 		{
 		}
 
-		packed_array::value_type
-		packed_array::get
-		(size_type pos_) const{
-			if(bwidth == value_width){
-				return buf[pos_];
+		/*
+			Writes the entries in range [pos, pos+count) to [output, output+count).
+			
+			Preconditions:
+			- pos + count <= size().
+			
+			Note:
+			- This is faster than get in a loop for sequential scans:
+			  the positions are not multiplied by the bit width,
+			  and the widths dividing 64 are decoded by words.
+		*/
+		void
+		packed_array::get_range
+		(size_type pos_, size_type count_, value_type *output_) const{
+			switch(bwidth){
+			case 1: get_aligned_range<1>(pos_, count_, output_); return;
+			case 2: get_aligned_range<2>(pos_, count_, output_); return;
+			case 4: get_aligned_range<4>(pos_, count_, output_); return;
+			case 8: get_aligned_range<8>(pos_, count_, output_); return;
+			case 16: get_aligned_range<16>(pos_, count_, output_); return;
+			case 32: get_aligned_range<32>(pos_, count_, output_); return;
+			case 64: std::copy(buf.data() + pos_, buf.data() + pos_ + count_, output_); return;
+			default: break;
 			}
-			value_type ret = 0;
-			size_type bit_pos = bwidth * pos_;
-			size_type bit_div = bit_pos / value_width;
-			size_type bit_mod = bit_pos % value_width;
-			ret = buf[bit_div] >> bit_mod;
-			if(value_width - bit_mod < bwidth){
-				ret |= buf[bit_div + 1] << (value_width - bit_mod);
+			const value_type *w = buf.data() + bwidth * pos_ / value_width;
+			size_type shift = bwidth * pos_ % value_width;
+			for(size_type i = 0; i < count_; ++i){
+				value_type val = w[0] >> shift;
+				if(shift + bwidth > value_width){
+					val |= w[1] << (value_width - shift);
+				}
+				output_[i] = low_bits(val, bwidth);
+				shift += bwidth;
+				w += shift / value_width;
+				shift %= value_width;
 			}
-			return ret & ((static_cast<value_type>(1) << bwidth) - 1);
 		}
 
+		/*
+			Copies the entries in range [begin, end) of src to the same positions of this array,
+			truncating them to the bit width of this array.
+			
+			Preconditions:
+			- begin is a multiple of 64, and end <= min(size(), src.size()).
+			
+			Note:
+			- The whole words are written by the repack kernel.
+			  The entries after end are kept even if they share a word with the last entry.
+		*/
 		void
-		packed_array::set
-		(size_type pos_, value_type val_){
-			if(bwidth == value_width){
-				buf[pos_] = val_;
-			}
-			else{
-				size_type bit_pos = bwidth * pos_;
-				size_type bit_div = bit_pos / value_width;
-				size_type bit_mod = bit_pos % value_width;
-				value_type mask = (static_cast<value_type>(1) << bwidth) - 1;
-				val_ &= mask;
-				
-				buf[bit_div] = (buf[bit_div] & ~(mask << bit_mod)) | (val_ << bit_mod);
-				size_type rest = value_width - bit_mod;
-				if(rest < bwidth){
-					buf[bit_div + 1] = (buf[bit_div + 1] & ~(mask >> rest)) | (val_ >> rest);
-				}
+		packed_array::copy_range
+		(const packed_array &src, size_type begin_, size_type end_){
+			const size_type aligned_end = std::max(begin_, end_ / value_width * value_width);
+			repack(src.buf.data(), src.bwidth, buf.data(), bwidth, begin_, aligned_end);
+			for(size_type i = aligned_end; i < end_; ++i){
+				set(i, src.get(i));
 			}
 		}
 
+		/*
+			Changes the bit width and the size, keeping the entries in range [0, min(size(), new_size)).
+			
+			Parameters:
+			- num_threads: The number of threads repacking the entries when the bit width changes.
+			  If it is 0, std::thread::hardware_concurrency() is used.
+			  Each thread repacks at least repack_chunk_size entries.
+			
+			Note:
+			- When the bit width is narrowed, the entries are truncated to the new width.
+		*/
 		void
 		packed_array::change_params
-		(size_type new_bit_width_, size_type new_size_){
+		(size_type new_bit_width_, size_type new_size_, unsigned num_threads){
 			if(new_bit_width_ == 0 || new_size_ == 0){
 				buf.clear();
 				bwidth = new_bit_width_;
@@ -83,10 +116,87 @@ namespace sdci{
 			}
 			else{
 				packed_array new_pa(new_bit_width_, new_size_);
-				for(size_type i = std::min(len, new_size_); i--; ){
-					new_pa.set(i, this->get(i));
+				const size_type count = std::min(len, new_size_);
+				if(num_threads == 0){
+					num_threads = std::max(1u, std::thread::hardware_concurrency());
+				}
+				const size_type num_chunks = (count + repack_chunk_size - 1) / repack_chunk_size;
+				num_threads = static_cast<unsigned>(std::max<size_type>(1, std::min<size_type>(num_threads, num_chunks)));
+
+				// chunk boundaries are multiples of 64 entries, so no word of new_pa is written by two threads
+				const value_type *src = buf.data();
+				value_type *dst = new_pa.buf.data();
+				const size_type src_width = bwidth;
+				const auto boundary = [&](size_type i){
+					return i == num_threads ? count : count * i / num_threads / value_width * value_width;
+				};
+				std::vector<std::thread> threads;
+				size_type started = 1;
+				try{
+					for(; started < num_threads; ++started){
+						threads.push_back(std::thread(
+							repack, src, src_width, dst, new_bit_width_, boundary(started), boundary(started + 1)
+						));
+					}
+				}
+				catch(...){
+					// the remaining chunks are repacked by this thread
+				}
+				repack(src, src_width, dst, new_bit_width_, 0, boundary(1));
+				for(size_type i = started; i < num_threads; ++i){
+					repack(src, src_width, dst, new_bit_width_, boundary(i), boundary(i + 1));
 				}
-				this->swap(new_pa);
+				for(size_type i = 0; i < threads.size(); ++i){
+					threads[i].join();
+				}
+
+				buf.replace(new_pa.buf);
+				bwidth = new_bit_width_;
+				len = new_size_;
+			}
+		}
+
+		/*
+			Copies the entries in range [begin, end) of the array of src_width bits
+			to the array of dst_width bits, which is zero-filled.
+			The source is read and the destination is written word by word,
+			without the read-modify-write of set.
+			
+			Preconditions:
+			- begin * dst_width is a multiple of 64.
+			- The word of dst containing the last entry is not written by others unless end is a multiple of 64.
+		*/
+		void
+		packed_array::repack
+		(const value_type *src, size_type src_width, value_type *dst, size_type dst_width,
+			size_type begin, size_type end
+		){
+			const size_type width = std::min(src_width, dst_width);
+			const value_type *s = src + src_width * begin / value_width;
+			size_type src_shift = src_width * begin % value_width;
+			value_type *d = dst + dst_width * begin / value_width;
+			size_type dst_shift = 0;
+			value_type acc = 0;
+			for(size_type i = begin; i < end; ++i){
+				value_type val = s[0] >> src_shift;
+				if(src_shift + src_width > value_width){
+					val |= s[1] << (value_width - src_shift);
+				}
+				val = low_bits(val, width);
+				src_shift += src_width;
+				s += src_shift / value_width;
+				src_shift %= value_width;
+
+				acc |= val << dst_shift;
+				dst_shift += dst_width;
+				if(dst_shift >= value_width){
+					*d++ = acc;
+					dst_shift -= value_width;
+					acc = (dst_shift != 0 ? val >> (dst_width - dst_shift) : 0);
+				}
+			}
+			if(dst_shift != 0){
+				*d = acc;
 			}
 		}
 		
@@ -106,9 +216,7 @@ namespace sdci{
 		}
 
 		void packed_array::shrink_to_fit(){
-			if(buf.size() != buf.capacity()){
-				std::vector<value_type>(buf).swap(buf);
-			}
+			buf.shrink_to_fit();
 		}
 
 		void packed_array::save_stream(std::ostream &stream, size_type save_size) const{
@@ -117,13 +225,58 @@ namespace sdci{
 		
 			::sdci::detail::write_data(stream, &bwidth);
 			::sdci::detail::write_data(stream, &save_size);
-			::sdci::detail::write_vector(stream, buf, num_write);
+			buf.save_stream(stream, num_write);
 		}
 
 		void packed_array::load_stream(std::istream &stream) try{
 			::sdci::detail::read_data(stream, &bwidth);
 			::sdci::detail::read_data(stream, &len);
-			::sdci::detail::read_vector(stream, buf);
+			buf.load_stream(stream);
+		}
+		catch(...){
+			bwidth = 0;
+			len = 0;
+			buf.clear();
+			throw;
+		}
+
+		// Writes the parameters of the array, whose entries are kept in a file.
+		void packed_array::save_header(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &bwidth);
+			::sdci::detail::write_data(stream, &len);
+		}
+
+		void packed_array::open_file(std::istream &header, const std::string &filename){
+			size_type bit_width_ = 0;
+			size_type size_ = 0;
+			::sdci::detail::read_data(header, &bit_width_);
+			::sdci::detail::read_data(header, &size_);
+			open_file(filename, bit_width_, size_);
+		}
+
+		// The words after the entries are cut off from the file.
+		void packed_array::open_file(const std::string &filename, size_type bit_width_, size_type size_) try{
+			if(bit_width_ > value_width || (bit_width_ == 0 && size_ != 0)){
+				::sdci::detail::formaterr();
+			}
+			bwidth = bit_width_;
+			len = size_;
+			buf.open_file(filename, get_necessary_size(bwidth, len));
+		}
+		catch(...){
+			bwidth = 0;
+			len = 0;
+			buf.clear();
+			throw;
+		}
+
+		void packed_array::map_memory(::sdci::detail::mapped_reader &reader) try{
+			reader.read(&bwidth);
+			reader.read(&len);
+			reader.read_words(buf);
+			if(bwidth > value_width || buf.size() < get_necessary_size(bwidth, len)){
+				::sdci::detail::formaterr();
+			}
 		}
 		catch(...){
 			bwidth = 0;
@@ -28,6 +28,12 @@
 #include <algorithm>
 #include <utility>
 #include <iostream>
+#include <string>
+#include "word_buffer.h"
+
+#if !defined(SDCI_NO_USE_BUILTINS) && defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 namespace sdci{
 	namespace detail{
@@ -44,9 +50,14 @@ namespace sdci{
 			size_type bit_width() const;
 			static size_type max_bit_width();
 			void swap(packed_array& other);
-			void change_params(size_type new_bit_width, size_type new_size);
+			void change_params(size_type new_bit_width, size_type new_size, unsigned num_threads = 1);
 			value_type get(size_type pos) const;
 			void set(size_type pos_, value_type val);
+			template <size_type BitWidth> value_type get_fixed(size_type pos) const;
+			template <size_type BitWidth> void set_fixed(size_type pos, value_type val);
+			void get_range(size_type pos, size_type count, value_type *output) const;
+			void copy_range(const packed_array &src, size_type begin, size_type end);
+			void prefetch(size_type pos) const;
 			void shrink_to_fit();
 			void clear();
 			void fill0();
@@ -54,6 +65,15 @@ namespace sdci{
 			size_type heap_usage() const;
 			void save_stream(std::ostream &stream, size_type save_size = size_type(-1)) const;
 			void load_stream(std::istream &stream);
+			void map_memory(::sdci::detail::mapped_reader &reader);
+			bool mapped() const;
+			bool file_backed() const;
+			void detach();
+			void attach_file(const std::string &filename);
+			void save_header(std::ostream &stream) const;
+			void open_file(std::istream &header, const std::string &filename);
+			void open_file(const std::string &filename, size_type bit_width_, size_type size_);
+			void sync() const;
 
 #if __cplusplus >= 201103L
 			packed_array(const packed_array&) = default;
@@ -66,9 +86,19 @@ namespace sdci{
 		private:
 			size_type bwidth;
 			size_type len;
-			std::vector<value_type> buf;
+			::sdci::detail::word_buffer buf;
 
 			static size_type get_necessary_size(size_type bit_width, size_type size);
+			enum{ repack_chunk_size = 1 << 20 };
+			static void repack(
+				const value_type *src, size_type src_width, value_type *dst, size_type dst_width,
+				size_type begin, size_type end
+			);
+			static value_type low_bits(value_type val, size_type bit_width);
+			static value_type read_field(const value_type *words, size_type bit_pos, size_type bit_width);
+			static void write_field(value_type *words, size_type bit_pos, size_type bit_width, value_type val);
+			template <size_type BitWidth>
+			void get_aligned_range(size_type pos, size_type count, value_type *output) const;
 		
 		};
 	
@@ -93,6 +123,110 @@ namespace sdci{
 			return value_width;
 		}
 		
+		// Hints that the entry at pos will be read soon.
+		inline void
+		packed_array::prefetch(size_type pos_) const{
+#if !defined(SDCI_NO_USE_BUILTINS) && (defined(__GNUC__) || (defined(__clang__)))
+			if(pos_ < len){
+				__builtin_prefetch(buf.data() + bwidth * pos_ / value_width);
+			}
+#else
+			static_cast<void>(pos_);
+#endif
+		}
+
+		// Returns the lowest bit_width bits of val (0 < bit_width <= 64).
+		inline packed_array::value_type
+		packed_array::low_bits(value_type val_, size_type bit_width_){
+#if !defined(SDCI_NO_USE_BUILTINS) && defined(__BMI2__)
+			return _bzhi_u64(val_, static_cast<unsigned int>(bit_width_));
+#else
+			return val_ & (value_type(-1) >> (value_width - bit_width_));
+#endif
+		}
+
+		// A field straddles at most two words, and the second one is read only when it does.
+		inline packed_array::value_type
+		packed_array::read_field(const value_type *words_, size_type bit_pos_, size_type bit_width_){
+			const value_type *w = words_ + bit_pos_ / value_width;
+			const size_type shift = bit_pos_ % value_width;
+			value_type ret = w[0] >> shift;
+			if(shift + bit_width_ > value_width){
+				ret |= w[1] << (value_width - shift);
+			}
+			return low_bits(ret, bit_width_);
+		}
+
+		inline void
+		packed_array::write_field(value_type *words_, size_type bit_pos_, size_type bit_width_, value_type val_){
+			value_type *w = words_ + bit_pos_ / value_width;
+			const size_type shift = bit_pos_ % value_width;
+			const value_type mask = value_type(-1) >> (value_width - bit_width_);
+			val_ &= mask;
+			w[0] = (w[0] & ~(mask << shift)) | (val_ << shift);
+			if(shift + bit_width_ > value_width){
+				const size_type rest = value_width - shift;
+				w[1] = (w[1] & ~(mask >> rest)) | (val_ >> rest);
+			}
+		}
+
+		inline packed_array::value_type
+		packed_array::get(size_type pos_) const{
+			return read_field(buf.data(), bwidth * pos_, bwidth);
+		}
+
+		inline void
+		packed_array::set(size_type pos_, value_type val_){
+			write_field(buf.data(), bwidth * pos_, bwidth, val_);
+		}
+
+		/*
+			get and set for the arrays whose bit width is known at compile time.
+			
+			Precondition:
+			- bit_width() == BitWidth.
+			
+			Note:
+			- The shifts and the mask are constants,
+			  and when BitWidth divides 64, the check of straddling fields is removed.
+		*/
+		template <packed_array::size_type BitWidth>
+		inline packed_array::value_type
+		packed_array::get_fixed(size_type pos_) const{
+			static_assert(0 < BitWidth && BitWidth <= value_width, "packed_array::get_fixed");
+			return read_field(buf.data(), BitWidth * pos_, BitWidth);
+		}
+
+		template <packed_array::size_type BitWidth>
+		inline void
+		packed_array::set_fixed(size_type pos_, value_type val_){
+			static_assert(0 < BitWidth && BitWidth <= value_width, "packed_array::set_fixed");
+			write_field(buf.data(), BitWidth * pos_, BitWidth, val_);
+		}
+
+		// Decodes whole words at once; the inner loop has constant shifts and is vectorized by the compiler.
+		template <packed_array::size_type BitWidth>
+		void
+		packed_array::get_aligned_range(size_type pos_, size_type count_, value_type *output_) const{
+			enum{ per_word = value_width / BitWidth };
+			const value_type mask = value_type(-1) >> (value_width - BitWidth);
+			for(; count_ > 0 && pos_ % per_word != 0; --count_){
+				*output_++ = get_fixed<BitWidth>(pos_++);
+			}
+			const value_type *w = buf.data() + pos_ / per_word;
+			for(; count_ >= per_word; count_ -= per_word){
+				const value_type word = *w++;
+				for(size_type j = 0; j < per_word; ++j){
+					output_[j] = (word >> (j * BitWidth)) & mask;
+				}
+				output_ += per_word;
+				pos_ += per_word;
+			}
+			for(; count_ > 0; --count_){
+				*output_++ = get_fixed<BitWidth>(pos_++);
+			}
+		}
+
 		inline void
 		packed_array::swap(packed_array &other){
 			std::swap(bwidth, other.bwidth);
@@ -102,18 +236,45 @@ namespace sdci{
 		
 		inline void
 		packed_array::clear(){
-			std::vector<value_type>().swap(buf);
+			buf.clear();
 			len = 0;
 		}
 
 		inline void
 		packed_array::fill0(){
-			std::fill(buf.begin(), buf.end(), value_type());
+			buf.fill(value_type());
 		}
 
 		inline void
 		packed_array::fill1(){
-			std::fill(buf.begin(), buf.end(), value_type(-1));
+			buf.fill(value_type(-1));
+		}
+
+		// Returns true if the entries are viewed in mapped memory, and then they must not be set.
+		inline bool
+		packed_array::mapped() const{
+			return buf.is_view();
+		}
+
+		inline bool
+		packed_array::file_backed() const{
+			return buf.is_file_backed();
+		}
+
+		inline void
+		packed_array::detach(){
+			buf.detach();
+		}
+
+		// Moves the entries into the file and keeps them there (see word_buffer).
+		inline void
+		packed_array::attach_file(const std::string &filename){
+			buf.attach_file(filename);
+		}
+
+		inline void
+		packed_array::sync() const{
+			buf.sync();
 		}
 
 		inline packed_array::size_type
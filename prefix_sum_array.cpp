@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "prefix_sum_array.h"
+
+namespace sdci{
+	namespace detail{
+		prefix_sum_array::prefix_sum_array(size_type size_){
+			initialize(size_);
+		}
+
+		void prefix_sum_array::initialize(size_type size_) try{
+			sum = 0;
+			tree.change_params(1, size_);
+			tree.fill0();
+		}
+		catch(...){
+			sum = 0;
+			tree.clear();
+			throw;
+		}
+
+		void prefix_sum_array::reserve(value_type max_total){
+			const size_type new_width = ::sdci::detail::ceillg64(max_total + 1);
+			if(new_width > tree.bit_width()){
+				tree.change_params(new_width, tree.size());
+			}
+		}
+
+		void prefix_sum_array::increment(size_type pos){
+			if(tree.bit_width() < ::sdci::detail::packed_array::max_bit_width() &&
+				((sum + 1) >> tree.bit_width()) != 0
+			){
+				reserve(sum + 1);
+			}
+			++sum;
+			const size_type n = tree.size();
+			for(size_type i = pos + 1; i <= n; i += i & (~i + 1)){
+				tree.set(i - 1, tree.get(i - 1) + 1);
+			}
+		}
+
+		void prefix_sum_array::add(size_type pos, value_type value){
+			if(value == 0){
+				return;
+			}
+			reserve(sum + value);
+			sum += value;
+			const size_type n = tree.size();
+			for(size_type i = pos + 1; i <= n; i += i & (~i + 1)){
+				tree.set(i - 1, tree.get(i - 1) + value);
+			}
+		}
+
+		// The counter at pos must be positive.
+		void prefix_sum_array::decrement(size_type pos){
+			--sum;
+			const size_type n = tree.size();
+			for(size_type i = pos + 1; i <= n; i += i & (~i + 1)){
+				tree.set(i - 1, tree.get(i - 1) - 1);
+			}
+		}
+
+		void prefix_sum_array::clear(){
+			if(sum != 0){
+				tree.fill0();
+				sum = 0;
+			}
+		}
+
+		void prefix_sum_array::save_stream(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &sum);
+			tree.save_stream(stream);
+		}
+
+		void prefix_sum_array::load_stream(std::istream &stream) try{
+			::sdci::detail::read_data(stream, &sum);
+			tree.load_stream(stream);
+		}
+		catch(...){
+			sum = 0;
+			tree.clear();
+			throw;
+		}
+
+		void prefix_sum_array::save_header(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &sum);
+			tree.save_header(stream);
+		}
+
+		void prefix_sum_array::open_file(std::istream &header, const std::string &filename) try{
+			::sdci::detail::read_data(header, &sum);
+			tree.open_file(header, filename);
+		}
+		catch(...){
+			sum = 0;
+			tree.clear();
+			throw;
+		}
+
+		void prefix_sum_array::map_memory(::sdci::detail::mapped_reader &reader) try{
+			reader.read(&sum);
+			tree.map_memory(reader);
+		}
+		catch(...){
+			sum = 0;
+			tree.clear();
+			throw;
+		}
+	}
+}
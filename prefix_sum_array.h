@@ -0,0 +1,159 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SDCI_PREFIX_SUM_ARRAY_H_INCLUDED
+#define SDCI_PREFIX_SUM_ARRAY_H_INCLUDED
+
+#include "sdci_common.h"
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include "packed_array.h"
+
+namespace sdci{
+	namespace detail{
+		// Counters with prefix sums (Fenwick tree).
+		// The bit width of the counters grows with the total of them.
+		class prefix_sum_array{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+			typedef ::sdci::detail::uint64_type value_type;
+
+			explicit prefix_sum_array(size_type size = 0);
+			void initialize(size_type size);
+			void reserve(value_type max_total);
+			void increment(size_type pos);
+			void decrement(size_type pos);
+			void add(size_type pos, value_type value);
+			value_type prefix_sum(size_type pos) const;
+			value_type range_sum(size_type first, size_type last) const;
+			size_type search(value_type rank) const;
+			value_type total() const;
+			size_type size() const;
+			void clear();
+			void swap(prefix_sum_array &other);
+			size_type heap_usage() const;
+			void save_stream(std::ostream &stream) const;
+			void load_stream(std::istream &stream);
+			void map_memory(::sdci::detail::mapped_reader &reader);
+			bool mapped() const;
+			void detach();
+			void attach_file(const std::string &filename);
+			void save_header(std::ostream &stream) const;
+			void open_file(std::istream &header, const std::string &filename);
+			void sync() const;
+
+#if __cplusplus >= 201103L
+			prefix_sum_array(const prefix_sum_array &) = default;
+			prefix_sum_array(prefix_sum_array &&) = default;
+			prefix_sum_array& operator= (const prefix_sum_array &) = default;
+			prefix_sum_array& operator= (prefix_sum_array &&) = default;
+			~prefix_sum_array() = default;
+#endif
+
+		private:
+			value_type sum;
+			::sdci::detail::packed_array tree;
+		};
+
+		// inline functions
+
+		// Returns the sum of the counters in [0, pos).
+		inline prefix_sum_array::value_type
+		prefix_sum_array::prefix_sum(size_type pos) const{
+			value_type ret = 0;
+			for(size_type i = pos; i > 0; i &= i - 1){
+				ret += tree.get(i - 1);
+			}
+			return ret;
+		}
+
+		// Returns the sum of the counters in [first, last).
+		inline prefix_sum_array::value_type
+		prefix_sum_array::range_sum(size_type first, size_type last) const{
+			return prefix_sum(last) - prefix_sum(first);
+		}
+
+		// Returns the position of the counter containing the (rank+1)-th unit,
+		// i.e. the maximum pos such that prefix_sum(pos) <= rank, or size() if rank >= total().
+		inline prefix_sum_array::size_type
+		prefix_sum_array::search(value_type rank) const{
+			const size_type n = tree.size();
+			if(rank >= sum){
+				return n;
+			}
+			size_type pos = 0;
+			for(size_type step = n != 0 ? size_type(1) << ::sdci::detail::smsb64(n) : 0; step != 0; step >>= 1){
+				if(pos + step <= n){
+					const value_type v = tree.get(pos + step - 1);
+					if(v <= rank){
+						pos += step;
+						rank -= v;
+					}
+				}
+			}
+			return pos;
+		}
+
+		inline prefix_sum_array::value_type
+		prefix_sum_array::total() const{
+			return sum;
+		}
+
+		inline prefix_sum_array::size_type
+		prefix_sum_array::size() const{
+			return tree.size();
+		}
+
+		inline void
+		prefix_sum_array::swap(prefix_sum_array &other){
+			std::swap(sum, other.sum);
+			tree.swap(other.tree);
+		}
+
+		inline bool
+		prefix_sum_array::mapped() const{
+			return tree.mapped();
+		}
+
+		inline void
+		prefix_sum_array::detach(){
+			tree.detach();
+		}
+
+		inline void
+		prefix_sum_array::attach_file(const std::string &filename){
+			tree.attach_file(filename);
+		}
+
+		inline void
+		prefix_sum_array::sync() const{
+			tree.sync();
+		}
+
+		inline prefix_sum_array::size_type
+		prefix_sum_array::heap_usage() const{
+			return tree.heap_usage();
+		}
+	}
+}
+
+#endif
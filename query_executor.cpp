@@ -0,0 +1,154 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "query_executor.h"
+#include <chrono>
+#include <iterator>
+#include <algorithm>
+
+namespace sdci{
+	query_executor::query_executor(const semidynamic_compact_index &index, unsigned num_threads)
+	: m_index(index), m_tasks(num_threads != 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency())),
+	  m_generation(0), m_running(0), m_stop(false), m_requests(0), m_results(0)
+	{
+		num_threads = static_cast<unsigned>(m_tasks.thread_count());
+		m_stats.resize(num_threads);
+		try{
+			for(unsigned i = 0; i < num_threads; ++i){
+				m_threads.push_back(std::thread(&query_executor::worker_main, this, i));
+			}
+		}
+		catch(...){
+			{
+				std::lock_guard<std::mutex> lock(m_mtx);
+				m_stop = true;
+			}
+			m_start_cv.notify_all();
+			for(size_type i = 0; i < m_threads.size(); ++i){
+				m_threads[i].join();
+			}
+			throw;
+		}
+	}
+
+	query_executor::~query_executor(){
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stop = true;
+		}
+		m_start_cv.notify_all();
+		for(size_type i = 0; i < m_threads.size(); ++i){
+			m_threads[i].join();
+		}
+	}
+
+	void query_executor::run(const std::vector<query_request> &requests, std::vector<query_result> &results){
+		std::lock_guard<std::mutex> run_lock(m_run_mtx);
+		results.assign(requests.size(), query_result());
+		const size_type num_threads = m_tasks.thread_count();
+		m_tasks.clear();
+		for(size_type w = 0; w < num_threads; ++w){
+			// the owner takes its queries in order from the back, and thieves take the last ones from the front
+			for(size_type i = requests.size() * (w + 1) / num_threads; i-- > requests.size() * w / num_threads; ){
+				m_tasks.push(w, i);
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(m_mtx);
+		m_requests = &requests;
+		m_results = &results;
+		m_error = std::exception_ptr();
+		m_running = static_cast<unsigned>(num_threads);
+		++m_generation;
+		m_start_cv.notify_all();
+		m_done_cv.wait(lock, [this]{ return m_running == 0; });
+		m_requests = 0;
+		m_results = 0;
+
+		if(m_error){
+			std::exception_ptr error = m_error;
+			m_error = std::exception_ptr();
+			std::rethrow_exception(error);
+		}
+	}
+
+	void query_executor::worker_main(unsigned id){
+		typedef std::chrono::steady_clock clock_type;
+		size_type generation = 0;
+		while(true){
+			{
+				std::unique_lock<std::mutex> lock(m_mtx);
+				m_start_cv.wait(lock, [&]{ return m_stop || m_generation != generation; });
+				if(m_stop){
+					return;
+				}
+				generation = m_generation;
+			}
+
+			query_worker_stats stats = {0, 0, 0, 0.0};
+			const clock_type::time_point start = clock_type::now();
+			size_type task = 0;
+			while(m_tasks.pop(id, task, stats.steals)){
+				query_result &result = (*m_results)[task];
+				try{
+					execute((*m_requests)[task], result);
+				}
+				catch(...){
+					std::lock_guard<std::mutex> lock(m_mtx);
+					if(!m_error){
+						m_error = std::current_exception();
+					}
+				}
+				++stats.queries;
+				stats.values += result.values.size();
+				m_tasks.done();
+			}
+			stats.busy_seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stats[id] = stats;
+			if(--m_running == 0){
+				m_done_cv.notify_all();
+			}
+		}
+	}
+
+	void query_executor::execute(const query_request &request, query_result &result) const{
+		result.values.clear();
+		result.count = 0;
+		switch(request.kind){
+		case query_request::locate_query:
+			m_index.locate(request.pattern.begin(), request.pattern.end(), std::back_inserter(result.values));
+			result.count = result.values.size();
+			break;
+		case query_request::count_query:
+			result.count = m_index.count(request.pattern.begin(), request.pattern.end());
+			break;
+		case query_request::extract_query:
+			if(request.from < m_index.text_length()){
+				result.values.resize(std::min(request.length, m_index.text_length() - request.from));
+				m_index.extract(request.from, request.length, result.values.begin());
+			}
+			result.count = result.values.size();
+			break;
+		}
+	}
+}
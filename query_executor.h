@@ -0,0 +1,197 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SDCI_QUERY_EXECUTOR_H_INCLUDED
+#define SDCI_QUERY_EXECUTOR_H_INCLUDED
+
+#include "semidynamic_compact_index.h"
+#include "work_stealing_queue.h"
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace sdci{
+	/*
+		A query to semidynamic_compact_index.
+	*/
+	struct query_request{
+		typedef semidynamic_compact_index::size_type size_type;
+
+		enum kind_type{ locate_query, count_query, extract_query };
+
+		/*
+			The kind of query.
+		*/
+		kind_type kind;
+
+		/*
+			The pattern of locate_query and count_query.
+		*/
+		std::vector<size_type> pattern;
+
+		/*
+			The starting position and the length of extract_query.
+		*/
+		size_type from;
+		size_type length;
+	};
+
+	/*
+		The result of a query.
+	*/
+	struct query_result{
+		typedef semidynamic_compact_index::size_type size_type;
+
+		/*
+			The occurrences (in any order) for locate_query,
+			or the extracted string for extract_query.
+		*/
+		std::vector<size_type> values;
+
+		/*
+			The number of occurrences for locate_query and count_query,
+			or the length of extracted string for extract_query.
+		*/
+		size_type count;
+	};
+
+	/*
+		Statistics of a worker thread in the last batch.
+	*/
+	struct query_worker_stats{
+		typedef semidynamic_compact_index::size_type size_type;
+
+		/*
+			The number of queries processed by the worker.
+		*/
+		size_type queries;
+
+		/*
+			The number of queries which the worker stole from other workers.
+		*/
+		size_type steals;
+
+		/*
+			The total number of values stored to the results by the worker.
+		*/
+		size_type values;
+
+		/*
+			The time (in seconds) from the start of the batch
+			until the worker found no more queries.
+		*/
+		double busy_seconds;
+	};
+
+	/*
+		Runs batches of queries to a semidynamic_compact_index in parallel.
+		The queries in a batch are distributed to the worker threads evenly,
+		and a worker which has finished its own queries steals the queries of the others.
+	*/
+	class query_executor{
+	public:
+		typedef semidynamic_compact_index::size_type size_type;
+
+		/*
+			Starts the worker threads.
+
+			Parameters
+			- index: The index to which the queries are made.
+			- num_threads: The number of worker threads. If it is 0, std::thread::hardware_concurrency() is used.
+
+			Note
+			- index must not be modified or destroyed while this executor is running a batch.
+		*/
+		explicit query_executor(const semidynamic_compact_index &index, unsigned num_threads = 0);
+
+		/*
+			Stops the worker threads.
+		*/
+		~query_executor();
+
+		/*
+			Runs a batch of queries and waits for their completion.
+
+			Parameters
+			- requests: The queries.
+			- results: results[i] is set to the result of requests[i].
+
+			Note
+			- If some query throws an exception (e.g. a pattern is too long),
+			  the other queries are still processed and then one of the exceptions is rethrown.
+			- This function can be called from several threads; the batches are run one at a time.
+		*/
+		void run(const std::vector<query_request> &requests, std::vector<query_result> &results);
+
+		/*
+			Returns the number of worker threads.
+		*/
+		unsigned thread_count() const;
+
+		/*
+			Returns the statistics of each worker thread in the last batch.
+			It must not be called while another thread is in run().
+		*/
+		const std::vector<query_worker_stats>& last_stats() const;
+
+#if __cplusplus >= 201103L
+		query_executor(const query_executor &) = delete;
+		query_executor& operator= (const query_executor &) = delete;
+#endif
+
+	private:
+		void worker_main(unsigned id);
+		void execute(const query_request &request, query_result &result) const;
+
+		const semidynamic_compact_index &m_index;
+		::sdci::detail::work_stealing_queue<size_type> m_tasks;
+		std::vector<std::thread> m_threads;
+		std::vector<query_worker_stats> m_stats;
+
+		// held by run() for the whole batch, so that the batches of concurrent callers do not mix
+		std::mutex m_run_mtx;
+
+		std::mutex m_mtx;
+		std::condition_variable m_start_cv;
+		std::condition_variable m_done_cv;
+		size_type m_generation;
+		unsigned m_running;
+		bool m_stop;
+		std::exception_ptr m_error;
+		const std::vector<query_request> *m_requests;
+		std::vector<query_result> *m_results;
+	};
+
+	inline unsigned
+	query_executor::thread_count() const{
+		return static_cast<unsigned>(m_threads.size());
+	}
+
+	inline const std::vector<query_worker_stats>&
+	query_executor::last_stats() const{
+		return m_stats;
+	}
+}
+
+#endif
@@ -29,93 +29,140 @@ namespace sdci{
 		const sampled_position_list::size_type sampled_position_list::npos;
 
 		sampled_position_list::sampled_position_list
-		(size_type entry_number, size_type reserved_node_size){
+		(size_type entry_number, size_type reserved_node_size)
+		: incremental(false), growth_point(npos), migration_end(npos),
+		  migrated_first(0), migrated_next(0), migration_step(0)
+		{
 			initialize(entry_number, reserved_node_size);
 		}
 
 		void sampled_position_list::initialize
 		(size_type entry_number, size_type reserved_node_size) try{
+			cancel_growth();
 			num_nodes = 0;
+			if(incremental){
+				reserved_node_size = std::max<size_type>(reserved_node_size, entry_number / incremental_entries_per_node);
+			}
 
 			size_type lg_num_nodes = ::sdci::detail::ceillg64(reserved_node_size + 2);
 			lfirst.change_params(lg_num_nodes, entry_number);
 			lnext.change_params(lg_num_nodes, reserved_node_size);
+			reset_growth_point();
 		}
 		catch(...){
 			lfirst.clear();
 			lnext.clear();
+			reset_growth_point();
 			throw;
 		}
 
 		void sampled_position_list::reserve(size_type reserved_node_size){
+			if(migrating() && reserved_node_size <= next_lnext.size()){
+				return;
+			}
+			finish_growth();
 			if(reserved_node_size > num_nodes){
 				size_type lg_num_nodes = ::sdci::detail::ceillg64(reserved_node_size + 2);
 				if(lg_num_nodes > lfirst.bit_width()){
-					lfirst.change_params(lg_num_nodes, lfirst.size());
-					lnext.change_params(lg_num_nodes, reserved_node_size);
+					lfirst.change_params(lg_num_nodes, lfirst.size(), 0);
+					lnext.change_params(lg_num_nodes, reserved_node_size, 0);
 				}
-				else if(lg_num_nodes == lnext.bit_width() && reserved_node_size > lnext.size()){ 
-					lnext.change_params(lg_num_nodes, reserved_node_size);
+				else if(reserved_node_size > lnext.size()){
+					// the nodes may be wider than needed, e.g. after the lists reserved for the incremental growth are loaded
+					lnext.change_params(lnext.bit_width(), reserved_node_size);
 				}
 			}
+			reset_growth_point();
 		}
 
-		void sampled_position_list::insert_first(size_type entry) try{
-			if(num_nodes + 1 >= lnext.size()){
-				size_type next_reserve_v = ::sdci::detail::multiply_limited<size_type>(num_nodes, 2, -3);
-				size_type represent =
-					(lnext.bit_width() == ::sdci::detail::packed_array::max_bit_width()
-						? 1ull << lnext.bit_width()
-						: -3ull
-					);
-				if(next_reserve_v > represent){
-					next_reserve_v = ::sdci::detail::multiply_limited<size_type>(represent, 2, -3);
-				}
+		void sampled_position_list::resize_entries(size_type entry_number){
+			finish_growth();
+			const bool shrink = entry_number < lfirst.size();
+			lfirst.change_params(lfirst.bit_width(), entry_number);
+			if(shrink){
+				lfirst.shrink_to_fit();
+			}
+			reset_growth_point();
+		}
 
-				next_reserve_v = std::max<size_type>(next_reserve_v, 16);
+		void sampled_position_list::grow(){
+			size_type next_reserve_v = ::sdci::detail::multiply_limited<size_type>(num_nodes, 2, -3);
+			size_type represent =
+				(lnext.bit_width() == ::sdci::detail::packed_array::max_bit_width()
+					? 1ull << lnext.bit_width()
+					: -3ull
+				);
+			if(next_reserve_v > represent){
+				next_reserve_v = ::sdci::detail::multiply_limited<size_type>(represent, 2, -3);
+			}
 
-				reserve(next_reserve_v);
+			next_reserve_v = std::max<size_type>(next_reserve_v, 16);
+
+			reserve(next_reserve_v);
+		}
+
+		void sampled_position_list::insert_first(size_type entry) try{
+			if(num_nodes >= growth_point){
+				advance_growth();
+			}
+			if(num_nodes + 1 >= node_capacity()){
+				grow();
 			}
 
-			const size_type val = lfirst.get(entry);
-			lnext.set(num_nodes, val);
-			lfirst.set(entry, ++num_nodes);
+			::sdci::detail::packed_array &first = first_array(entry);
+			const size_type val = first.get(entry);
+			next_array(num_nodes).set(num_nodes, val);
+			first.set(entry, ++num_nodes);
 		}
 		catch(...){
+			cancel_growth();
 			lfirst.clear();
 			lnext.clear();
 			num_nodes = 0;
+			reset_growth_point();
 			throw;
 		}
 
-		sampled_position_list::size_type
-		sampled_position_list::first_node(size_type entry) const{
-			if(entry < lfirst.size()){
-				return lfirst.get(entry) - 1;
+		void sampled_position_list::append_nodes(size_type count) try{
+			finish_growth();
+			const size_type new_num_nodes = num_nodes + count;
+			while(num_nodes < new_num_nodes){
+				// the arrays grow at the same node numbers as in insert_first
+				if(num_nodes + 1 >= lnext.size()){
+					grow();
+				}
+				num_nodes = std::min(new_num_nodes, lnext.size() - 1);
 			}
-			return npos;
 		}
-
-		sampled_position_list::size_type
-		sampled_position_list::next_node(size_type node_number) const{
-			if(node_number < lnext.size()){
-				return lnext.get(node_number) - 1;
-			}
-			return npos;
+		catch(...){
+			cancel_growth();
+			lfirst.clear();
+			lnext.clear();
+			num_nodes = 0;
+			reset_growth_point();
+			throw;
 		}
 
 		void sampled_position_list::shrink_to_fit() try{
+			finish_growth();
 			size_type lg_num_nodes = ::sdci::detail::ceillg64(num_nodes + 2);
-			lfirst.change_params(lg_num_nodes, lfirst.size());
-			lnext.change_params(lg_num_nodes, lnext.size());
+			lfirst.change_params(lg_num_nodes, lfirst.size(), 0);
+			lnext.change_params(lg_num_nodes, lnext.size(), 0);
+			reset_growth_point();
 		}
 		catch(...){
+			cancel_growth();
 			lfirst.clear();
 			lnext.clear();
 			num_nodes = 0;
+			reset_growth_point();
 		}
 
 		void sampled_position_list::clear(){
+			if(migrating()){
+				cancel_growth();
+				reset_growth_point();
+			}
 			if(num_nodes > 0){
 				lfirst.fill0();
 //				lnext.fill0();
@@ -124,22 +171,184 @@ namespace sdci{
 		}
 
 		void sampled_position_list::save_stream(std::ostream &stream) const{
+			if(migrating()){
+				sampled_position_list finished(*this);
+				finished.finish_growth();
+				finished.save_stream(stream);
+				return;
+			}
 			::sdci::detail::write_data(stream, &num_nodes);
 			lfirst.save_stream(stream);
 			lnext.save_stream(stream, num_nodes);
 		}
 
 		void sampled_position_list::load_stream(std::istream &stream) try{
+			cancel_growth();
 			::sdci::detail::read_data(stream, &num_nodes);
 			lfirst.load_stream(stream);
 			lnext.load_stream(stream);
+			reset_growth_point();
 		}
 		catch(...){
 			num_nodes = 0;
 			lfirst.clear();
 			lnext.clear();
+			reset_growth_point();
 			throw;
 		}
+
+		// The lists are kept in the files filename_prefix + ".lfirst" and filename_prefix + ".lnext".
+		void sampled_position_list::attach_file(const std::string &filename_prefix){
+			finish_growth();
+			lfirst.attach_file(filename_prefix + ".lfirst");
+			lnext.attach_file(filename_prefix + ".lnext");
+			reset_growth_point();
+		}
+
+		void sampled_position_list::save_header(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &num_nodes);
+			lfirst.save_header(stream);
+			lnext.save_header(stream);
+		}
+
+		void sampled_position_list::open_file(std::istream &header, const std::string &filename_prefix) try{
+			cancel_growth();
+			::sdci::detail::read_data(header, &num_nodes);
+			lfirst.open_file(header, filename_prefix + ".lfirst");
+			lnext.open_file(header, filename_prefix + ".lnext");
+			reset_growth_point();
+		}
+		catch(...){
+			num_nodes = 0;
+			lfirst.clear();
+			lnext.clear();
+			reset_growth_point();
+			throw;
+		}
+
+		void sampled_position_list::map_memory(::sdci::detail::mapped_reader &reader) try{
+			cancel_growth();
+			reader.read(&num_nodes);
+			lfirst.map_memory(reader);
+			lnext.map_memory(reader);
+			reset_growth_point();
+		}
+		catch(...){
+			num_nodes = 0;
+			lfirst.clear();
+			lnext.clear();
+			reset_growth_point();
+			throw;
+		}
+
+		void sampled_position_list::set_incremental_growth(bool enable){
+			if(enable == incremental){
+				return;
+			}
+			finish_growth();
+			incremental = enable;
+			if(enable){
+				reserve(std::max(
+					lfirst.size() / incremental_entries_per_node,
+					::sdci::detail::multiply_limited<size_type>(num_nodes, 2, -3)
+				));
+			}
+			reset_growth_point();
+		}
+
+		void sampled_position_list::reset_growth_point(){
+			growth_point = (incremental && !lnext.file_backed() ? lnext.size() / 2 : npos);
+		}
+
+		/*
+			Migrates migration_step nodes of lnext, and then migration_step entries of lfirst per call,
+			starting a migration if none is in progress.
+			The step is chosen at the start so that the migration ends
+			before the nodes use half of the remaining capacity of lnext.
+		*/
+		void sampled_position_list::advance_growth(){
+			if(!migrating()){
+				start_growth();
+				if(!migrating()){
+					return;
+				}
+			}
+			if(num_nodes + 1 >= lnext.size()){
+				// the old arrays cannot hold more nodes
+				finish_growth();
+				return;
+			}
+
+			if(migrated_next < migration_end){
+				const size_type end = std::min(migration_end, migrated_next + migration_step);
+				next_lnext.copy_range(lnext, migrated_next, end);
+				migrated_next = end;
+			}
+			else if(migrated_first < next_lfirst.size()){
+				const size_type end = std::min(next_lfirst.size(), migrated_first + migration_step);
+				next_lfirst.copy_range(lfirst, migrated_first, end);
+				migrated_first = end;
+			}
+			if(migrated_next == migration_end && migrated_first == next_lfirst.size()){
+				finish_growth();
+			}
+		}
+
+		void sampled_position_list::start_growth(){
+			const size_type capacity = lnext.size();
+			size_type new_capacity = ::sdci::detail::multiply_limited<size_type>(capacity, 2, -3);
+			if(lnext.bit_width() == ::sdci::detail::packed_array::max_bit_width()){
+				new_capacity = -3ull;
+			}
+			new_capacity = std::max<size_type>(new_capacity, 16);
+			if(new_capacity <= capacity){
+				growth_point = npos;
+				return;
+			}
+
+			const size_type new_width = std::max<size_type>(lfirst.bit_width(), ::sdci::detail::ceillg64(new_capacity + 2));
+			::sdci::detail::packed_array(new_width, new_capacity).swap(next_lnext);
+			if(new_width != lfirst.bit_width()){
+				::sdci::detail::packed_array(new_width, lfirst.size()).swap(next_lfirst);
+			}
+
+			const size_type work = num_nodes + next_lfirst.size();
+			const size_type budget = (capacity > num_nodes + 1 ? (capacity - num_nodes - 1) / 2 : 0);
+			const size_type step = (budget > 2 ? work / (budget - 2) + 1 : work);
+			migration_step = std::max<size_type>((step + 63) / 64 * 64, 64);
+			migration_end = num_nodes;
+			migrated_next = 0;
+			migrated_first = 0;
+			growth_point = 0;
+		}
+
+		void sampled_position_list::finish_growth(){
+			if(!migrating()){
+				return;
+			}
+			if(migrated_next < migration_end){
+				next_lnext.copy_range(lnext, migrated_next, migration_end);
+			}
+			if(migrated_first < next_lfirst.size()){
+				next_lfirst.copy_range(lfirst, migrated_first, next_lfirst.size());
+			}
+			lnext.swap(next_lnext);
+			if(next_lfirst.bit_width() != 0){
+				lfirst.swap(next_lfirst);
+			}
+			cancel_growth();
+			reset_growth_point();
+		}
+
+		// Discards the new arrays of the migration in progress.
+		void sampled_position_list::cancel_growth(){
+			::sdci::detail::packed_array().swap(next_lfirst);
+			::sdci::detail::packed_array().swap(next_lnext);
+			migration_end = npos;
+			migrated_first = 0;
+			migrated_next = 0;
+			migration_step = 0;
+		}
 	}
 }
 
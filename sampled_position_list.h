@@ -27,6 +27,7 @@
 #include <climits>
 #include <stdexcept>
 #include <iostream>
+#include <string>
 #include "packed_array.h"
 
 namespace sdci{
@@ -41,17 +42,57 @@ namespace sdci{
 			explicit sampled_position_list(size_type entry_number = 0, size_type reserved_node_size = 0);
 			void initialize(size_type entry_number, size_type reserved_node_size = 0);
 			void reserve(size_type size);
+
+			/*
+				Changes the number of entries. The entries added have empty lists,
+				and the memory of the entries removed is released.
+				A migration of the incremental growth in progress is finished at once.
+			*/
+			void resize_entries(size_type entry_number);
 			void insert_first(size_type entry);
+
+			/*
+				Adds count nodes after the last node without linking them,
+				as a bulk alternative to count calls of insert_first.
+				The links of the new nodes must be set by set_first_node and set_next_node.
+				Different threads may call set_next_node concurrently
+				for node ranges which are disjoint and aligned to multiples of 64.
+			*/
+			void append_nodes(size_type count);
+			void set_first_node(size_type entry, size_type node_number);
+			void set_next_node(size_type node_number, size_type next);
+
 			size_type first_node(size_type entry) const;
 			size_type next_node(size_type node_number) const;
+			void prefetch_first(size_type entry) const;
 			void swap(sampled_position_list &other);
 			size_type entry_size() const;
 			size_type node_size() const;
 			void shrink_to_fit();
 			void clear();
+
+			/*
+				Enables or disables the incremental growth.
+				In this mode, when the nodes fill half of the capacity,
+				the lists start migrating to new arrays of twice the capacity,
+				and each call of insert_first migrates at most a constant number of entries
+				instead of copying all of them at once when the capacity runs out.
+				Enabling it reserves at least entry_size()/incremental_entries_per_node nodes,
+				which bounds the entries migrated per insertion.
+				The growth of the lists kept in files is not incremental.
+			*/
+			void set_incremental_growth(bool enable);
+			bool incremental_growth() const;
 			size_type heap_usage() const;
 			void save_stream(std::ostream &stream) const;
 			void load_stream(std::istream &stream);
+			void map_memory(::sdci::detail::mapped_reader &reader);
+			bool mapped() const;
+			void detach();
+			void attach_file(const std::string &filename_prefix);
+			void save_header(std::ostream &stream) const;
+			void open_file(std::istream &header, const std::string &filename_prefix);
+			void sync() const;
 
 #if __cplusplus >= 201103L
 			sampled_position_list(const sampled_position_list &) = default;
@@ -62,9 +103,41 @@ namespace sdci{
 #endif
 			
 		private:
+			enum{ incremental_entries_per_node = 16 };
+
 			size_type num_nodes;
 			::sdci::detail::packed_array lfirst;
 			::sdci::detail::packed_array lnext;
+
+			/*
+				The state of the incremental growth.
+				During a migration, the entries of lfirst in [0, migrated_first)
+				and the nodes in [0, migrated_next) or in [migration_end, num_nodes)
+				are stored in next_lfirst and next_lnext.
+				If next_lfirst has no bit width, lfirst is not migrated.
+				insert_first advances the growth when num_nodes >= growth_point.
+			*/
+			bool incremental;
+			size_type growth_point;
+			size_type migration_end;
+			size_type migrated_first;
+			size_type migrated_next;
+			size_type migration_step;
+			::sdci::detail::packed_array next_lfirst;
+			::sdci::detail::packed_array next_lnext;
+
+			void grow();
+			bool migrating() const;
+			size_type node_capacity() const;
+			const ::sdci::detail::packed_array& first_array(size_type entry) const;
+			::sdci::detail::packed_array& first_array(size_type entry);
+			const ::sdci::detail::packed_array& next_array(size_type node_number) const;
+			::sdci::detail::packed_array& next_array(size_type node_number);
+			void advance_growth();
+			void start_growth();
+			void finish_growth();
+			void cancel_growth();
+			void reset_growth_point();
 		};
 		
 		//inline functions
@@ -80,16 +153,110 @@ namespace sdci{
 			return num_nodes;
 		}
 		
+		inline bool
+		sampled_position_list::migrating() const{
+			return migration_end != npos;
+		}
+
+		inline sampled_position_list::size_type
+		sampled_position_list::node_capacity() const{
+			return migrating() ? next_lnext.size() : lnext.size();
+		}
+
+		inline const ::sdci::detail::packed_array&
+		sampled_position_list::first_array(size_type entry) const{
+			return entry < migrated_first ? next_lfirst : lfirst;
+		}
+
+		inline ::sdci::detail::packed_array&
+		sampled_position_list::first_array(size_type entry){
+			return entry < migrated_first ? next_lfirst : lfirst;
+		}
+
+		// When no migration is in progress, migrated_next is 0 and migration_end is npos.
+		inline const ::sdci::detail::packed_array&
+		sampled_position_list::next_array(size_type node_number) const{
+			return node_number - migrated_next < migration_end - migrated_next ? lnext : next_lnext;
+		}
+
+		inline ::sdci::detail::packed_array&
+		sampled_position_list::next_array(size_type node_number){
+			return node_number - migrated_next < migration_end - migrated_next ? lnext : next_lnext;
+		}
+
+		inline void
+		sampled_position_list::set_first_node(size_type entry, size_type node_number){
+			first_array(entry).set(entry, node_number + 1);
+		}
+
+		inline void
+		sampled_position_list::set_next_node(size_type node_number, size_type next){
+			next_array(node_number).set(node_number, next + 1);
+		}
+
+		inline sampled_position_list::size_type
+		sampled_position_list::first_node(size_type entry) const{
+			const ::sdci::detail::packed_array &arr = first_array(entry);
+			if(entry < arr.size()){
+				return arr.get(entry) - 1;
+			}
+			return npos;
+		}
+
+		inline sampled_position_list::size_type
+		sampled_position_list::next_node(size_type node_number) const{
+			const ::sdci::detail::packed_array &arr = next_array(node_number);
+			if(node_number < arr.size()){
+				return arr.get(node_number) - 1;
+			}
+			return npos;
+		}
+
+		inline void
+		sampled_position_list::prefetch_first(size_type entry) const{
+			first_array(entry).prefetch(entry);
+		}
+
 		inline void
 		sampled_position_list::swap(sampled_position_list &other){
 			std::swap(this->num_nodes, other.num_nodes);
 			lfirst.swap(other.lfirst);
 			lnext.swap(other.lnext);
+			std::swap(incremental, other.incremental);
+			std::swap(growth_point, other.growth_point);
+			std::swap(migration_end, other.migration_end);
+			std::swap(migrated_first, other.migrated_first);
+			std::swap(migrated_next, other.migrated_next);
+			std::swap(migration_step, other.migration_step);
+			next_lfirst.swap(other.next_lfirst);
+			next_lnext.swap(other.next_lnext);
+		}
+
+		inline bool
+		sampled_position_list::mapped() const{
+			return lfirst.mapped() || lnext.mapped();
+		}
+
+		inline void
+		sampled_position_list::detach(){
+			lfirst.detach();
+			lnext.detach();
+		}
+
+		inline void
+		sampled_position_list::sync() const{
+			lfirst.sync();
+			lnext.sync();
+		}
+
+		inline bool
+		sampled_position_list::incremental_growth() const{
+			return incremental;
 		}
 
 		inline sampled_position_list::size_type
 		sampled_position_list::heap_usage() const{
-			return lfirst.heap_usage() + lnext.heap_usage();
+			return lfirst.heap_usage() + lnext.heap_usage() + next_lfirst.heap_usage() + next_lnext.heap_usage();
 		}
 	}
 }
@@ -31,6 +31,10 @@
 
 #include <stdint.h>
 
+#if !defined(SDCI_NO_USE_BUILTINS) && defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace sdci{
 	namespace detail{
 
@@ -178,6 +182,30 @@ namespace sdci{
 			return value ? smsb64((value - 1) | 1) + 1 : 0;
 		}
 
+		// the number of setted bits
+		inline unsigned popcount64(uint64_type value){
+#if !defined(SDCI_NO_USE_BUILTINS) && (defined(__GNUC__) || (defined(__clang__)))
+			return __builtin_popcountll(value);
+#else
+			value = value - ((value >> 1) & 0x5555555555555555ull);
+			value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+			value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+			return static_cast<unsigned>((value * 0x0101010101010101ull) >> 56);
+#endif
+		}
+
+		// the position of the (rank+1)-th setted bit (rank < popcount64(value))
+		inline unsigned select64(uint64_type value, unsigned rank){
+#if !defined(SDCI_NO_USE_BUILTINS) && defined(__BMI2__)
+			return slsb64(_pdep_u64(uint64_type(1) << rank, value));
+#else
+			for(; rank > 0; --rank){
+				value &= value - 1;
+			}
+			return slsb64(value);
+#endif
+		}
+
 		inline void formaterr(){
 			throw std::runtime_error("Format error");
 		}
@@ -199,8 +227,8 @@ namespace sdci{
 			}
 		}
 
-		template <class Tp>
-		inline void read_vector(std::istream& stream, std::vector<Tp>& vec) try{
+		template <class Tp, class Alloc>
+		inline void read_vector(std::istream& stream, std::vector<Tp, Alloc>& vec) try{
 			size_type size = 0;
 			read_data(stream, &size);
 			vec.resize(size);
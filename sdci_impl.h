@@ -24,18 +24,29 @@
 #define SDCI_SDCI_IMPL_H_INCLUDED
 
 namespace sdci{
+	// If sigma is a power of two, the q-grams are encoded with lg(sigma) bits per character,
+	// and these are computed by shifts instead of multiplication and division.
 	inline semidynamic_compact_index::encode_type 
 	semidynamic_compact_index::lshift(encode_type value, size_type ch_len) const{
+		if(m_shift_encoding){
+			return value << (ch_len * m_lg_sigma);
+		}
 		return value * m_pow_sigma[ch_len];
 	}
 	
 	inline semidynamic_compact_index::encode_type 
 	semidynamic_compact_index::rshift(encode_type value, size_type ch_len) const{
+		if(m_shift_encoding){
+			return value >> (ch_len * m_lg_sigma);
+		}
 		return value / m_pow_sigma[ch_len];
 	}
 	
 	inline semidynamic_compact_index::encode_type
 	semidynamic_compact_index::mask(encode_type value, size_type ch_len) const{
+		if(m_shift_encoding){
+			return value & (m_pow_sigma[ch_len] - 1);
+		}
 		return value % m_pow_sigma[ch_len];
 	}
 
@@ -74,11 +85,102 @@ namespace sdci{
 		return m_param_k;
 	}
 
+	inline bool
+	semidynamic_compact_index::fast_count_enabled() const{
+		return m_fast_count;
+	}
+
+	inline bool
+	semidynamic_compact_index::incremental_growth_enabled() const{
+		return m_list_sampled.incremental_growth();
+	}
+
+	inline bool
+	semidynamic_compact_index::qgram_rank_enabled() const{
+		return m_encQ.rank_enabled();
+	}
+
+	inline bool
+	semidynamic_compact_index::sparse_directory_enabled() const{
+		return m_sparse_directory;
+	}
+
+	inline bool
+	semidynamic_compact_index::directory_compacted() const{
+		return m_compact_directory;
+	}
+
+	// Returns the entry of the q-gram in the lists and the edges,
+	// which is the q-gram itself unless the directory is sparse or compacted.
+	// With the compact directory, the q-gram must occur in the text.
+	inline semidynamic_compact_index::size_type
+	semidynamic_compact_index::qgram_slot(encode_type qgram) const{
+		if(m_sparse_directory){
+			return m_sparse_qgrams.find(qgram);
+		}
+		if(m_compact_directory){
+			return m_qgram_ranks.get(qgram / compact_rank_interval) + m_encQ.word_rank(qgram);
+		}
+		return qgram;
+	}
+
+	// Adds the q-gram to the set of q-grams of the text and returns its entry.
+	inline semidynamic_compact_index::size_type
+	semidynamic_compact_index::insert_qgram(encode_type qgram, bool &first_appearance){
+		if(m_compact_directory){
+			if(m_encQ.contains(qgram)){
+				first_appearance = false;
+				return qgram_slot(qgram);
+			}
+			compact_directory(false);
+		}
+		if(!m_sparse_directory){
+			first_appearance = m_encQ.insert(qgram);
+			return qgram;
+		}
+		const size_type slot = m_sparse_qgrams.insert(qgram, first_appearance);
+		if(slot >= m_efirst.size()){
+			grow_qgram_slots();
+		}
+		return slot;
+	}
+
+	inline bool
+	semidynamic_compact_index::qgram_iterator::next(size_type &qgram){
+		if(m_sparse){
+			return m_sparse_qgrams.next(qgram);
+		}
+		return m_dense_qgrams.next(qgram);
+	}
+
+	inline bool
+	semidynamic_compact_index::mapped() const{
+		return m_mapped;
+	}
+
+	inline bool
+	semidynamic_compact_index::persistent() const{
+		return !m_persistent.dirname.empty();
+	}
+
+	// The arrays viewed in a mapped file are copied before they are modified,
+	// and a persistent index is marked as modified since the last sync.
+	inline void
+	semidynamic_compact_index::make_writable(){
+		if(m_mapped){
+			detach_arrays();
+		}
+		if(!m_persistent.dirty && persistent()){
+			mark_dirty();
+		}
+	}
+
 	inline semidynamic_compact_index::size_type
 	semidynamic_compact_index::heap_usage() const{
 		return
 			m_list_sampled.heap_usage() + m_efirst.heap_usage() +
 			m_enext.heap_usage() + m_encQ.heap_usage() +
+			m_sparse_qgrams.heap_usage() + m_qgram_ranks.heap_usage() + m_qgram_count.heap_usage() +
 			m_pow_sigma.capacity() * sizeof(m_pow_sigma[0]);
 	}
 
@@ -95,7 +197,10 @@ namespace sdci{
 	template <class ForwardIterator>
 	void semidynamic_compact_index::reserve_if_able
 	(ForwardIterator first, ForwardIterator last, std::forward_iterator_tag){
-		reserve(m_textlen + std::distance(first, last));
+		// in the incremental growth mode, the lists must not be grown at once
+		if(!incremental_growth_enabled()){
+			reserve(m_textlen + std::distance(first, last));
+		}
 	}
 
 	template <class InputIterator>
@@ -114,35 +219,216 @@ namespace sdci{
 		if(m_sigma == 0){
 			throw std::runtime_error("semidynamic_compact_index::append");
 		}
+		make_writable();
 
 		typedef typename std::iterator_traits<InputIterator>::iterator_category category;
 		reserve_if_able(first, last, category());
+		::sdci::detail::packed_array *const text_log = persistent() ? &m_persistent.text : 0;
 
 		for(; first != last; ++first){
 			const encode_type next_ch = static_cast<encode_type>(*first);
 			if(next_ch >= m_sigma){
 				invalidarg(next_ch);
 			}
+			if(text_log != 0){
+				if(m_textlen >= text_log->size()){
+					reserve_text_log(m_textlen + 1);
+				}
+				text_log->set(m_textlen, next_ch);
+			}
 			const encode_type next_qgram =
 				lshift(mask(m_last_qgram, m_param_q - 1), 1) + next_ch;
 			++m_textlen;
 
 			if(m_textlen >= m_param_q){
+				bool first_appearance = false;
+				const size_type slot = insert_qgram(next_qgram, first_appearance);
 				if(m_textlen == m_next_sampling_pos){
-					m_list_sampled.insert_first(next_qgram);
+					m_list_sampled.insert_first(slot);
 					m_next_sampling_pos += m_param_k;
 				}
 
 				if(m_first_appearance){
-					m_enext.set(m_last_qgram, m_efirst.get(next_qgram));
-					m_efirst.set(next_qgram, rshift(m_last_qgram, m_param_q - 1) + 1);
+					m_enext.set(qgram_slot(m_last_qgram), m_efirst.get(slot));
+					m_efirst.set(slot, rshift(m_last_qgram, m_param_q - 1) + 1);
+				}
+				m_first_appearance = first_appearance;
+				if(m_fast_count){
+					m_qgram_count.increment(next_qgram);
 				}
-				m_first_appearance = m_encQ.insert(next_qgram);
 			}
 			m_last_qgram = next_qgram;
 		}
 	}
 
+	template <class RandomAccessIterator>
+	void semidynamic_compact_index::assign_parallel
+	(RandomAccessIterator first, RandomAccessIterator last, unsigned num_threads){
+		if(num_threads == 0){
+			num_threads = hardware_threads();
+		}
+		const size_type textlen = last - first;
+		const size_type num_nodes = textlen >= m_param_q ? (textlen - m_param_q) / m_param_k + 1 : 0;
+		// each chunk has enough sampled positions to be worth a thread
+		num_threads = static_cast<unsigned>(std::min<size_type>(num_threads, num_nodes / 4096));
+		if(num_threads <= 1 || m_sigma == 0 || m_sparse_directory){
+			assign(first, last);
+			return;
+		}
+
+		clear();
+		reserve(textlen);
+		try{
+			m_list_sampled.append_nodes(num_nodes);
+
+			// the boundaries are aligned so that the threads write disjoint words of the lists
+			std::vector<build_chunk> chunks(num_threads);
+			for(size_type i = 0; i < num_threads; ++i){
+				chunks[i].begin = (num_nodes * i / num_threads) / 64 * 64 * m_param_k;
+			}
+			for(size_type i = 0; i + 1 < num_threads; ++i){
+				chunks[i].end = chunks[i + 1].begin;
+			}
+			chunks.back().end = textlen - m_param_q + 1;
+
+			run_parallel(num_threads, [&](size_type i){
+				build_chunk_lists(first, num_nodes, chunks[i]);
+			});
+			merge_chunks(first, textlen, chunks);
+			if(persistent()){
+				reserve_text_log(textlen);
+				for(size_type i = 0; i < textlen; ++i){
+					m_persistent.text.set(i, static_cast<encode_type>(first[i]));
+				}
+			}
+		}
+		catch(...){
+			m_list_sampled.clear();
+			m_efirst.fill0();
+			m_encQ.clear();
+			m_qgram_count.clear();
+			clear();
+			throw;
+		}
+	}
+
+	// Returns the q-gram starting at text[pos].
+	template <class RandomAccessIterator>
+	semidynamic_compact_index::encode_type
+	semidynamic_compact_index::qgram_at(RandomAccessIterator text, size_type pos) const{
+		encode_type qgram = 0;
+		for(size_type i = 0; i < m_param_q; ++i){
+			qgram = lshift(qgram, 1) + static_cast<encode_type>(text[pos + i]);
+		}
+		return qgram;
+	}
+
+	/*
+		Scans the q-grams starting in [chunk.begin, chunk.end).
+		The first occurrences in the chunk are collected,
+		and the sampled positions are linked to the previous ones of the same q-gram in the chunk.
+		The first sampled position of each q-gram in the chunk is left to merge_chunks.
+	*/
+	template <class RandomAccessIterator>
+	void semidynamic_compact_index::build_chunk_lists
+	(RandomAccessIterator text, size_type num_nodes, build_chunk &chunk){
+		const size_type kinds_of_qgrams = m_pow_sigma.back();
+		chunk.seen.initialize(kinds_of_qgrams);
+		chunk.heads.change_params(::sdci::detail::ceillg64(num_nodes + 2), kinds_of_qgrams);
+
+		encode_type qgram = 0;
+		for(size_type i = 0; i + 1 < m_param_q; ++i){
+			const encode_type ch = static_cast<encode_type>(text[chunk.begin + i]);
+			if(ch >= m_sigma){
+				invalidarg(ch);
+			}
+			qgram = lshift(qgram, 1) + ch;
+		}
+
+		size_type sampling = chunk.begin % m_param_k;
+		for(size_type pos = chunk.begin; pos < chunk.end; ++pos){
+			const encode_type ch = static_cast<encode_type>(text[pos + m_param_q - 1]);
+			if(ch >= m_sigma){
+				invalidarg(ch);
+			}
+			qgram = lshift(mask(qgram, m_param_q - 1), 1) + ch;
+
+			if(chunk.seen.insert(qgram)){
+				chunk.firsts.push_back(pos);
+			}
+			if(sampling == 0){
+				const size_type node = pos / m_param_k;
+				const size_type head = chunk.heads.get(qgram);
+				if(head == 0){
+					chunk.stitches.push_back(std::make_pair(qgram, node));
+				}
+				else{
+					m_list_sampled.set_next_node(node, head - 1);
+				}
+				chunk.heads.set(qgram, node + 1);
+			}
+			if(++sampling == m_param_k){
+				sampling = 0;
+			}
+		}
+	}
+
+	/*
+		Merges the chunks in order:
+		the lists of each q-gram are concatenated,
+		and the first occurrences in the text are found among those in the chunks
+		to make the edges as append() does.
+	*/
+	template <class RandomAccessIterator>
+	void semidynamic_compact_index::merge_chunks
+	(RandomAccessIterator text, size_type textlen, std::vector<build_chunk> &chunks){
+		const size_type last_pos = textlen - m_param_q;
+		for(size_type c = 0; c < chunks.size(); ++c){
+			build_chunk &chunk = chunks[c];
+			for(size_type i = 0; i < chunk.stitches.size(); ++i){
+				const encode_type qgram = chunk.stitches[i].first;
+				m_list_sampled.set_next_node(chunk.stitches[i].second, m_list_sampled.first_node(qgram));
+				m_list_sampled.set_first_node(qgram, chunk.heads.get(qgram) - 1);
+			}
+
+			for(size_type i = 0; i < chunk.firsts.size(); ++i){
+				const size_type pos = chunk.firsts[i];
+				const encode_type qgram = qgram_at(text, pos);
+				if(!m_encQ.insert(qgram)){
+					continue;
+				}
+				if(pos == last_pos){
+					m_first_appearance = true;
+				}
+				else{
+					const encode_type next_qgram =
+						lshift(mask(qgram, m_param_q - 1), 1) + static_cast<encode_type>(text[pos + m_param_q]);
+					m_enext.set(qgram, m_efirst.get(next_qgram));
+					m_efirst.set(next_qgram, rshift(qgram, m_param_q - 1) + 1);
+				}
+			}
+
+			chunk.seen.initialize(0);
+			chunk.heads.clear();
+			std::vector<size_type>().swap(chunk.firsts);
+			std::vector<std::pair<encode_type, size_type> >().swap(chunk.stitches);
+		}
+
+		if(m_fast_count){
+			encode_type qgram = 0;
+			for(size_type i = 0; i < textlen; ++i){
+				qgram = lshift(mask(qgram, m_param_q - 1), 1) + static_cast<encode_type>(text[i]);
+				if(i + 1 >= m_param_q){
+					m_qgram_count.increment(qgram);
+				}
+			}
+		}
+
+		m_textlen = textlen;
+		m_last_qgram = qgram_at(text, last_pos);
+		m_next_sampling_pos = m_param_q + m_list_sampled.node_size() * m_param_k;
+	}
+
 	template <class InputIterator, class OutputIterator>
 	OutputIterator semidynamic_compact_index::locate
 	(InputIterator first, InputIterator last, OutputIterator result) const
@@ -153,19 +439,16 @@ namespace sdci{
 
 		encode_type ptn_enc = 0;
 		size_type ptn_len = 0;
-		for(; first != last; ++first){
-			const encode_type next = static_cast<encode_type>(*first);
-			if(next >= m_sigma){
-				return result;
-			}
-
-			ptn_enc = lshift(ptn_enc, 1) + next;
-			++ptn_len;
-			if(ptn_len > max_pattern_size()){
-				ptnlenerr();
-			}
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return result;
 		}
+		return locate_encoded(ptn_enc, ptn_len, result);
+	}
 
+	template <class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate_encoded
+	(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const
+	{
 		if(ptn_len > m_textlen){
 			return result;
 		}
@@ -185,56 +468,255 @@ namespace sdci{
 		const encode_type ptn_first = lshift(ptn_enc, difflen);
 		const encode_type ptn_last = lshift(ptn_enc + 1, difflen);
 
-		typedef ::sdci::detail::integer_set::value_type signed_enc_type;
-		for(signed_enc_type p = m_encQ.successor(static_cast<signed_enc_type>(ptn_first) - 1);
-			static_cast<encode_type>(p) < ptn_last;
-			p = m_encQ.successor(p)
-		){
-			result = locate_dfs(p, 0, result);
+		std::vector<encode_type> frontier;
+		frontier.reserve(locate_batch_size);
+		qgram_iterator qgrams(*this, ptn_first, ptn_last);
+		for(size_type p = 0; qgrams.next(p); ){
+			frontier.push_back(p);
+			if(frontier.size() == locate_batch_size){
+				result = locate_frontier(frontier, 0, result);
+			}
 		}
+		result = locate_frontier(frontier, 0, result);
 
-		const size_type covered = ((m_textlen - m_param_q) / m_param_k + 1) * m_param_k;
-		const size_type offset = m_textlen - m_param_q;
+		return locate_tail(ptn_enc, ptn_len, result);
+	}
+
+	// Outputs the occurrences which are not derived from the q-grams with the pattern as prefix,
+	// i.e. those in the last (q-1) characters.
+	template <class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate_tail
+	(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const
+	{
+		const size_type difflen = m_param_q - ptn_len;
 		for(size_type i = 1; i <= difflen; ++i){
 			if(mask(rshift(m_last_qgram, difflen - i), ptn_len) == ptn_enc){
-				if(i + offset >= covered){
-					*result = i + offset;
+				result = locate_tail_at(i, result);
+			}
+		}
+
+		return result;
+	}
+
+	// Outputs the occurrence at the i-th character (1 <= i < q) of the last q-gram, for locate_tail().
+	template <class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate_tail_at(size_type i, OutputIterator result) const{
+		const size_type covered = ((m_textlen - m_param_q) / m_param_k + 1) * m_param_k;
+		const size_type offset = m_textlen - m_param_q;
+		if(i + offset >= covered){
+			*result = i + offset;
+			++result;
+		}
+		else if(m_first_appearance){
+			std::vector<encode_type> frontier(1, m_last_qgram);
+			result = locate_frontier(frontier, i, result);
+		}
+		return result;
+	}
+
+	// Outputs the occurrences derived from the q-grams of the text in the ranges, in one traversal.
+	template <class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate_ranges
+	(const std::vector<qgram_range> &ranges, OutputIterator result) const
+	{
+		std::vector<encode_type> frontier;
+		frontier.reserve(locate_batch_size);
+		for(size_type r = 0; r < ranges.size(); ++r){
+			qgram_iterator qgrams(*this, ranges[r].first, ranges[r].last);
+			for(size_type p = 0; qgrams.next(p); ){
+				frontier.push_back(p);
+				if(frontier.size() == locate_batch_size){
+					result = locate_frontier(frontier, 0, result);
+				}
+			}
+		}
+		return locate_frontier(frontier, 0, result);
+	}
+
+	template <class InputIterator, class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate_approx
+	(InputIterator first, InputIterator last, size_type max_distance, distance_type distance, OutputIterator result) const
+	{
+		if(first == last){
+			return result;
+		}
+
+		approx_search search;
+		search.max_distance = max_distance;
+		search.distance = distance;
+		for(; first != last; ++first){
+			const encode_type next = static_cast<encode_type>(*first);
+			search.pattern.push_back(next < m_sigma ? next : m_sigma);
+			if(search.pattern.size() > max_pattern_size()){
+				ptnlenerr();
+			}
+		}
+		start_approx_search(search);
+
+		if(m_textlen < m_param_q){
+			for(size_type i = 0; i < m_textlen; ++i){
+				if(approx_prefix_matches(search, mask(m_last_qgram, m_textlen - i), m_textlen - i)){
+					*result = i;
 					++result;
 				}
-				else if(m_first_appearance){
-					result = locate_dfs(m_last_qgram, i, result);
+			}
+			return result;
+		}
+
+		std::vector<qgram_range> ranges;
+		collect_approx_ranges(search, ranges);
+		result = locate_ranges(ranges, result);
+
+		// the occurrences in the last (q-1) characters, as in locate_tail()
+		for(size_type i = 1; i < m_param_q; ++i){
+			if(approx_prefix_matches(search, mask(m_last_qgram, m_param_q - i), m_param_q - i)){
+				result = locate_tail_at(i, result);
+			}
+		}
+
+		return result;
+	}
+
+	template <class OutputIterator>
+	OutputIterator semidynamic_compact_index::locate
+	(const class_pattern &pattern, OutputIterator result) const
+	{
+		const size_type len = pattern.size();
+		if(len == 0){
+			return result;
+		}
+		if(len > max_pattern_size()){
+			ptnlenerr();
+		}
+		if(len > m_textlen){
+			return result;
+		}
+
+		if(m_textlen < m_param_q){
+			for(size_type i = 0; i + len <= m_textlen; ++i){
+				if(class_matches(pattern, mask(m_last_qgram, m_textlen - i), m_textlen - i)){
+					*result = i;
+					++result;
 				}
 			}
+			return result;
+		}
+
+		std::vector<qgram_range> ranges;
+		collect_class_ranges(pattern, 0, 0, ranges);
+		result = locate_ranges(ranges, result);
+
+		for(size_type i = 1; i + len <= m_param_q; ++i){
+			if(class_matches(pattern, mask(m_last_qgram, m_param_q - i), m_param_q - i)){
+				result = locate_tail_at(i, result);
+			}
 		}
 
 		return result;
 	}
 
+	// Returns false if the pattern contains a character which the text cannot contain.
+	template <class InputIterator>
+	bool semidynamic_compact_index::encode_pattern
+	(InputIterator first, InputIterator last, encode_type &enc, size_type &len) const
+	{
+		enc = 0;
+		len = 0;
+		for(; first != last; ++first){
+			const encode_type next = static_cast<encode_type>(*first);
+			if(next >= m_sigma){
+				return false;
+			}
+
+			enc = lshift(enc, 1) + next;
+			++len;
+			if(len > max_pattern_size()){
+				ptnlenerr();
+			}
+		}
+		return true;
+	}
+
+	inline void
+	semidynamic_compact_index::prefetch_qgram(encode_type qgram, bool with_edges) const{
+		if(m_sparse_directory || m_compact_directory){
+			return;
+		}
+		prefetch_slot(qgram, with_edges);
+	}
+
+	inline void
+	semidynamic_compact_index::prefetch_slot(size_type slot, bool with_edges) const{
+		m_list_sampled.prefetch_first(slot);
+		if(with_edges){
+			m_efirst.prefetch(slot);
+		}
+	}
+
+	/*
+		Outputs the occurrences derived from the q-grams in frontier
+		and all their descendants, where offset is the depth of frontier.
+		The traversal proceeds level by level,
+		so that the entries of the q-grams in the next level can be prefetched.
+		The entry of each q-gram is looked up once, when it enters the frontier.
+		If stop_offset is given, the traversal stops before the depth stop_offset
+		and frontier is set to the q-grams of that depth;
+		otherwise frontier is empty after this function.
+	*/
 	template <class OutputIterator>
-	OutputIterator semidynamic_compact_index::locate_dfs
-	(encode_type ptn, size_type offset, OutputIterator result) const
+	OutputIterator semidynamic_compact_index::locate_frontier
+	(std::vector<encode_type> &frontier, size_type offset, OutputIterator result, size_type stop_offset) const
 	{
 		typedef ::sdci::detail::sampled_position_list::value_type list_value_type;
-		for(list_value_type nd = m_list_sampled.first_node(ptn);
-			nd != ::sdci::detail::sampled_position_list::npos;
-			nd = m_list_sampled.next_node(nd)
-		){
-
-			size_type pos = nd * m_param_k + offset;
-			*result = pos;
-			++result;
+		std::vector<encode_type> next;
+		std::vector<size_type> slots, next_slots;
+		if(offset < stop_offset){
+			slots.resize(frontier.size());
+			for(size_type i = 0; i < frontier.size(); ++i){
+				slots[i] = qgram_slot(frontier[i]);
+			}
 		}
-		
-		if(offset < m_param_k - 1){
-			encode_type eattr = m_efirst.get(ptn);
-			const encode_type rsptn = rshift(ptn, 1);
-			while(eattr != 0){
-				const encode_type nextptn = rsptn + lshift(eattr - 1, m_param_q - 1);
-				result = locate_dfs(nextptn, offset + 1, result);
-				eattr = m_enext.get(nextptn);
+		for(; !frontier.empty() && offset < stop_offset; ++offset){
+			const bool expand = (offset < m_param_k - 1);
+			const size_type num = frontier.size();
+			for(size_type i = 0; i < num && i < prefetch_distance; ++i){
+				prefetch_slot(slots[i], expand);
+			}
+
+			for(size_type i = 0; i < num; ++i){
+				if(i + prefetch_distance < num){
+					prefetch_slot(slots[i + prefetch_distance], expand);
+				}
+
+				const encode_type ptn = frontier[i];
+				const size_type slot = slots[i];
+				for(list_value_type nd = m_list_sampled.first_node(slot);
+					nd != ::sdci::detail::sampled_position_list::npos;
+					nd = m_list_sampled.next_node(nd)
+				){
+					size_type pos = nd * m_param_k + offset;
+					*result = pos;
+					++result;
+				}
+
+				if(expand){
+					encode_type eattr = m_efirst.get(slot);
+					const encode_type rsptn = rshift(ptn, 1);
+					while(eattr != 0){
+						const encode_type nextptn = rsptn + lshift(eattr - 1, m_param_q - 1);
+						const size_type next_slot = qgram_slot(nextptn);
+						next.push_back(nextptn);
+						next_slots.push_back(next_slot);
+						eattr = m_enext.get(next_slot);
+					}
+				}
 			}
+
+			frontier.swap(next);
+			next.clear();
+			slots.swap(next_slots);
+			next_slots.clear();
 		}
-		
 		return result;
 	}
 
@@ -243,7 +725,152 @@ namespace sdci{
 	semidynamic_compact_index::count
 	(InputIterator first, InputIterator last) const
 	{
-		return locate(first, last, ::sdci::detail::count_iterator()).count();
+		if(first == last){
+			return 0;
+		}
+
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return 0;
+		}
+		return count_encoded(ptn_enc, ptn_len);
+	}
+
+	template <class InputIterator>
+	semidynamic_compact_index::size_type
+	semidynamic_compact_index::distinct_qgrams
+	(InputIterator first, InputIterator last) const
+	{
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return 0;
+		}
+		return distinct_qgrams_encoded(ptn_enc, ptn_len);
+	}
+
+	template <class InputIterator>
+	void semidynamic_compact_index::locate_parallel
+	(InputIterator first, InputIterator last, std::vector<size_type> &result, unsigned num_threads) const
+	{
+		if(first == last){
+			return;
+		}
+
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return;
+		}
+		locate_parallel_encoded(ptn_enc, ptn_len, result, num_threads);
+	}
+
+	template <class PatternIterator>
+	void semidynamic_compact_index::encode_batch
+	(PatternIterator first, PatternIterator last, std::vector<batch_pattern> &patterns) const
+	{
+		patterns.clear();
+		for(; first != last; ++first){
+			batch_pattern ptn;
+			ptn.enc = 0;
+			ptn.len = 0;
+			ptn.range = size_type(-1);
+			if(std::begin(*first) == std::end(*first) ||
+				!encode_pattern(std::begin(*first), std::end(*first), ptn.enc, ptn.len)
+			){
+				ptn.len = 0;
+			}
+			patterns.push_back(ptn);
+		}
+	}
+
+	template <class PatternIterator>
+	void semidynamic_compact_index::locate_batch
+	(PatternIterator first, PatternIterator last, std::vector<std::vector<size_type> > &results) const
+	{
+		std::vector<batch_pattern> patterns;
+		encode_batch(first, last, patterns);
+		std::vector<qgram_range> ranges;
+		make_batch_ranges(patterns, ranges);
+
+		std::vector<std::vector<size_type> > occ(ranges.size());
+		sweep_batch(ranges, &occ, 0);
+
+		results.assign(patterns.size(), std::vector<size_type>());
+		for(size_type i = 0; i < patterns.size(); ++i){
+			const batch_pattern &ptn = patterns[i];
+			if(ptn.len == 0){
+				continue;
+			}
+			if(ptn.range == size_type(-1)){
+				locate_encoded(ptn.enc, ptn.len, std::back_inserter(results[i]));
+			}
+			else{
+				results[i] = occ[ptn.range];
+				locate_tail(ptn.enc, ptn.len, std::back_inserter(results[i]));
+			}
+		}
+	}
+
+	template <class PatternIterator>
+	void semidynamic_compact_index::count_batch
+	(PatternIterator first, PatternIterator last, std::vector<size_type> &results) const
+	{
+		std::vector<batch_pattern> patterns;
+		encode_batch(first, last, patterns);
+		results.assign(patterns.size(), 0);
+
+		std::vector<qgram_range> ranges;
+		if(!m_fast_count){
+			make_batch_ranges(patterns, ranges);
+		}
+		std::vector<size_type> cnt(ranges.size());
+		sweep_batch(ranges, 0, &cnt);
+
+		for(size_type i = 0; i < patterns.size(); ++i){
+			const batch_pattern &ptn = patterns[i];
+			if(ptn.len == 0){
+				continue;
+			}
+			if(ptn.range == size_type(-1)){
+				results[i] = count_encoded(ptn.enc, ptn.len);
+			}
+			else{
+				results[i] = cnt[ptn.range] +
+					locate_tail(ptn.enc, ptn.len, ::sdci::detail::count_iterator()).count();
+			}
+		}
+	}
+
+	template <class InputIterator>
+	semidynamic_compact_index::occurrence_cursor
+	semidynamic_compact_index::locate_cursor
+	(InputIterator first, InputIterator last) const
+	{
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(first == last || !encode_pattern(first, last, ptn_enc, ptn_len) || ptn_len > m_textlen){
+			return occurrence_cursor();
+		}
+		return occurrence_cursor(*this, ptn_enc, ptn_len);
+	}
+
+	inline bool
+	semidynamic_compact_index::occurrence_cursor::done() const{
+		return m_phase == phase_done;
+	}
+
+	template <class OutputIterator>
+	OutputIterator
+	semidynamic_compact_index::occurrence_cursor::fetch
+	(OutputIterator result, size_type max_count){
+		size_type pos = 0;
+		for(; max_count > 0 && next(pos); --max_count){
+			*result = pos;
+			++result;
+		}
+		return result;
 	}
 
 	template <class ForwardIterator>
@@ -267,10 +894,10 @@ namespace sdci{
 				++it;
 			}
 
-			const size_type kinds_of_qgrams = m_pow_sigma.back();
-			for(size_type w = m_encQ.successor(-1); w < kinds_of_qgrams; w = m_encQ.successor(w)){
+			qgram_iterator qgrams(*this, 0, m_pow_sigma.back());
+			for(size_type w = 0; qgrams.next(w); ){
 				typedef ::sdci::detail::sampled_position_list::value_type list_value_type;
-				for(list_value_type nd = m_list_sampled.first_node(w);
+				for(list_value_type nd = m_list_sampled.first_node(qgram_slot(w));
 					nd != ::sdci::detail::sampled_position_list::npos;
 					nd = m_list_sampled.next_node(nd)
 				){
@@ -333,10 +960,10 @@ namespace sdci{
 			if(remain == 0){
 				return retval;
 			}
-			const size_type kinds_of_qgrams = m_pow_sigma.back();
-			for(size_type w = m_encQ.successor(-1); w < kinds_of_qgrams; w = m_encQ.successor(w)){
+			qgram_iterator qgrams(*this, 0, m_pow_sigma.back());
+			for(size_type w = 0; qgrams.next(w); ){
 				typedef ::sdci::detail::sampled_position_list::value_type list_value_type;
-				for(list_value_type nd = m_list_sampled.first_node(w);
+				for(list_value_type nd = m_list_sampled.first_node(qgram_slot(w));
 					nd != ::sdci::detail::sampled_position_list::npos;
 					nd = m_list_sampled.next_node(nd)
 				){
@@ -20,26 +20,48 @@
 */
 
 #include "semidynamic_compact_index.h"
+#include "mapped_file.h"
+#include "work_stealing_queue.h"
 #include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <cstdio>
 
 namespace sdci{
+	namespace{
+		// the characters of the text are logged with this width in a persistent index
+		::sdci::detail::size_type text_log_width(::sdci::detail::size_type sigma){
+			return std::max(::sdci::detail::ceillg64(sigma), 1);
+		}
+
+		std::string file_path(const std::string &dirname, const char *name){
+			return dirname + "/" + name;
+		}
+	}
+
 	semidynamic_compact_index::semidynamic_compact_index()
-	: m_sigma(), m_param_q(), m_param_k()
+	: m_sigma(), m_param_q(), m_param_k(), m_fast_count(false), m_sparse_directory(false), m_compact_directory(false),
+	  m_mapped(false), m_shift_encoding(false), m_lg_sigma(0)
 	{
 		initialize(0, 0, 0);
 	}
 
 	semidynamic_compact_index::semidynamic_compact_index(
-		size_type sigma_, size_type param_q_, size_type param_k_
+		size_type sigma_, size_type param_q_, size_type param_k_, bool sparse_directory_
 	)
-	: m_sigma(), m_param_q(), m_param_k()
+	: m_sigma(), m_param_q(), m_param_k(), m_fast_count(false), m_sparse_directory(sparse_directory_), m_compact_directory(false),
+	  m_mapped(false), m_shift_encoding(false), m_lg_sigma(0)
 	{
 		initialize(sigma_, param_q_, param_k_);
 	}
 
 #if __cplusplus >= 201103L
 	semidynamic_compact_index::semidynamic_compact_index(semidynamic_compact_index&& from)
-	: m_sigma(), m_param_q(), m_param_k()
+	: m_sigma(), m_param_q(), m_param_k(), m_fast_count(false), m_sparse_directory(false), m_compact_directory(false),
+	  m_mapped(false), m_shift_encoding(false), m_lg_sigma(0)
 	{
 		initialize(0, 0, 0);
 		this->swap(from);
@@ -67,6 +89,47 @@ namespace sdci{
 			param_k_ = m_param_k;
 		}
 
+		if(persistent()){
+			// the arrays are initialized in their files, and the text log is left intact until the empty text is synced
+			mark_dirty();
+			persistent_state state;
+			state.swap(m_persistent);
+			try{
+				initialize(sigma_, param_q_, param_k_);
+			}
+			catch(...){
+				m_persistent.swap(state);
+				throw;
+			}
+			m_persistent.swap(state);
+			sync();
+			const size_type text_width = text_log_width(m_sigma);
+			if(text_width != m_persistent.text.bit_width()){
+				m_persistent.text.change_params(text_width, m_persistent.text.size());
+			}
+			return;
+		}
+
+		if(m_mapped){
+			// the mapped arrays are dropped instead of being copied
+			release_arrays();
+			m_sigma = 0;
+			m_param_q = 0;
+			m_param_k = 0;
+		}
+
+		if(m_sigma != 0){
+			// the arrays resized below keep their entries, so the old text is removed from them first
+			clear();
+			if(sigma_ == m_sigma && param_q_ == m_param_q && param_k_ == m_param_k){
+				return;
+			}
+		}
+
+		// the arrays are made again for all the possible q-grams
+		m_compact_directory = false;
+		::sdci::detail::packed_array().swap(m_qgram_ranks);
+
 		m_textlen = 0;
 		m_last_qgram = 0;
 		m_first_appearance = false;
@@ -101,15 +164,20 @@ namespace sdci{
 			throw std::overflow_error("semidynamic_compact_index::initialize");
 		}
 
+		// with the sparse directory, the entries are added as the q-grams appear
+		const size_type entries = m_sparse_directory ? 0 : kinds_of_qgrams;
 		size_type edge_width = ::sdci::detail::ceillg64(sigma_ + 1);
-		m_list_sampled.initialize(kinds_of_qgrams);
-		m_efirst.change_params(edge_width, kinds_of_qgrams);
-		m_enext.change_params(edge_width, kinds_of_qgrams);
-		m_encQ.initialize(kinds_of_qgrams);
+		m_list_sampled.initialize(entries);
+		m_efirst.change_params(edge_width, entries);
+		m_enext.change_params(edge_width, entries);
+		m_encQ.initialize(entries);
+		m_sparse_qgrams.initialize(m_sparse_directory ? kinds_of_qgrams : 0);
+		m_qgram_count.initialize(m_fast_count ? kinds_of_qgrams : 0);
 
 		m_sigma = sigma_;
 		m_param_q = param_q_;
 		m_param_k = param_k_;
+		set_encoding();
 	}
 	catch(...){
 		m_pow_sigma.clear();
@@ -117,13 +185,229 @@ namespace sdci{
 		m_efirst.clear();
 		m_enext.clear();
 		m_encQ.initialize(0);
+		m_sparse_qgrams.initialize(0);
+		m_qgram_count.initialize(0);
 		throw;
 	}
 
 	void semidynamic_compact_index::reserve(size_type reserve_size_){
+		make_writable();
 		if(m_param_k != 0){
 			m_list_sampled.reserve((reserve_size_ + m_param_k - 1) / m_param_k);
 		}
+		if(m_fast_count){
+			m_qgram_count.reserve(reserve_size_);
+		}
+		if(persistent()){
+			reserve_text_log(reserve_size_);
+		}
+	}
+
+	void semidynamic_compact_index::enable_incremental_growth(bool enable){
+		if(enable == incremental_growth_enabled()){
+			return;
+		}
+		make_writable();
+		m_list_sampled.set_incremental_growth(enable);
+	}
+
+	// The bits of m_encQ are only read, so that a mapped index need not be copied.
+	void semidynamic_compact_index::enable_qgram_rank(bool enable){
+		m_encQ.enable_rank(enable);
+	}
+
+	void semidynamic_compact_index::enable_sparse_directory(bool enable){
+		if(enable == m_sparse_directory){
+			return;
+		}
+		if(enable && m_fast_count){
+			throw std::invalid_argument("semidynamic_compact_index::enable_sparse_directory");
+		}
+
+		semidynamic_compact_index rebuilt(m_sigma, m_param_q, m_param_k, enable);
+		rebuilt.enable_incremental_growth(incremental_growth_enabled());
+		rebuilt.enable_qgram_rank(qgram_rank_enabled());
+		if(m_textlen != 0){
+			std::vector<encode_type> text(m_textlen);
+			retrieve(text.begin());
+			rebuilt.append(text.begin(), text.end());
+		}
+
+		if(!persistent()){
+			swap(rebuilt);
+			return;
+		}
+		// the files of the old arrays are released before the new arrays are stored in the directory
+		const std::string dirname = m_persistent.dirname;
+		swap(rebuilt);
+		semidynamic_compact_index().swap(rebuilt);
+		persist(dirname.c_str());
+	}
+
+	// The lists and the edges are extended to the capacity of the sparse directory.
+	void semidynamic_compact_index::grow_qgram_slots(){
+		const size_type entries = m_sparse_qgrams.capacity();
+		m_list_sampled.resize_entries(entries);
+		m_efirst.change_params(m_efirst.bit_width(), entries);
+		m_enext.change_params(m_enext.bit_width(), entries);
+	}
+
+	// The entries are moved in place: to lower positions in ascending order of the q-grams when compacted,
+	// and to higher positions in descending order when expanded, so that no entry is overwritten before it is moved.
+	void semidynamic_compact_index::compact_directory(bool compact){
+		if(compact == m_compact_directory || m_sigma == 0 || m_sparse_directory || persistent()){
+			return;
+		}
+		make_writable();
+
+		typedef ::sdci::detail::sampled_position_list list_type;
+		const size_type kinds_of_qgrams = m_pow_sigma.back();
+		const size_type num_qgrams = m_encQ.size();
+		if(compact){
+			::sdci::detail::packed_array ranks(
+				::sdci::detail::ceillg64(num_qgrams + 1), (kinds_of_qgrams + compact_rank_interval - 1) / compact_rank_interval
+			);
+			size_type block = 0;
+			size_type slot = 0;
+			qgram_iterator qgrams(*this, 0, kinds_of_qgrams);
+			for(size_type w = 0; qgrams.next(w); ++slot){
+				for(; block <= w / compact_rank_interval; ++block){
+					ranks.set(block, slot);
+				}
+				m_list_sampled.set_first_node(slot, m_list_sampled.first_node(w));
+				m_efirst.set(slot, m_efirst.get(w));
+				m_enext.set(slot, m_enext.get(w));
+			}
+			for(; block < ranks.size(); ++block){
+				ranks.set(block, slot);
+			}
+			m_list_sampled.resize_entries(num_qgrams);
+			m_efirst.change_params(m_efirst.bit_width(), num_qgrams);
+			m_enext.change_params(m_enext.bit_width(), num_qgrams);
+			m_efirst.shrink_to_fit();
+			m_enext.shrink_to_fit();
+			m_qgram_ranks.swap(ranks);
+			m_compact_directory = true;
+			return;
+		}
+
+		m_list_sampled.resize_entries(kinds_of_qgrams);
+		m_efirst.change_params(m_efirst.bit_width(), kinds_of_qgrams);
+		m_enext.change_params(m_enext.bit_width(), kinds_of_qgrams);
+		size_type slot = num_qgrams;
+		for(::sdci::detail::integer_set::value_type w = m_encQ.predecessor(kinds_of_qgrams);
+			w >= 0;
+			w = m_encQ.predecessor(w)
+		){
+			--slot;
+			if(size_type(w) == slot){
+				// the remaining q-grams are 0, 1, ..., slot
+				break;
+			}
+			m_list_sampled.set_first_node(w, m_list_sampled.first_node(slot));
+			m_efirst.set(w, m_efirst.get(slot));
+			m_enext.set(w, m_enext.get(slot));
+			m_list_sampled.set_first_node(slot, list_type::npos);
+			m_efirst.set(slot, 0);
+			m_enext.set(slot, 0);
+		}
+		::sdci::detail::packed_array().swap(m_qgram_ranks);
+		m_compact_directory = false;
+	}
+
+	semidynamic_compact_index::qgram_iterator::qgram_iterator()
+	: m_sparse(false), m_dense_qgrams(), m_sparse_qgrams()
+	{
+	}
+
+	semidynamic_compact_index::qgram_iterator::qgram_iterator
+	(const semidynamic_compact_index &index, encode_type first, encode_type last)
+	: m_sparse(index.m_sparse_directory), m_dense_qgrams(), m_sparse_qgrams()
+	{
+		if(m_sparse){
+			m_sparse_qgrams = ::sdci::detail::sparse_qgram_map::range_iterator(index.m_sparse_qgrams, first, last);
+		}
+		else{
+			m_dense_qgrams = ::sdci::detail::integer_set::range_iterator(index.m_encQ, first, last);
+		}
+	}
+
+	void semidynamic_compact_index::enable_fast_count(bool enable){
+		if(enable == m_fast_count){
+			return;
+		}
+		if(enable && m_sparse_directory){
+			throw std::invalid_argument("semidynamic_compact_index::enable_fast_count");
+		}
+		if(!enable){
+			if(persistent()){
+				mark_dirty();
+			}
+			::sdci::detail::prefix_sum_array().swap(m_qgram_count);
+			m_fast_count = false;
+			return;
+		}
+		make_writable();
+
+		::sdci::detail::prefix_sum_array counts(m_sigma != 0 ? m_pow_sigma.back() : 0);
+		if(m_sigma != 0 && m_textlen >= m_param_q){
+			std::vector<encode_type> text(m_textlen);
+			retrieve(text.begin());
+			counts.reserve(m_textlen);
+			encode_type qgram = 0;
+			for(size_type i = 0; i < m_textlen; ++i){
+				qgram = lshift(mask(qgram, m_param_q - 1), 1) + text[i];
+				if(i + 1 >= m_param_q){
+					counts.increment(qgram);
+				}
+			}
+		}
+		m_qgram_count.swap(counts);
+		m_fast_count = true;
+		if(persistent()){
+			m_qgram_count.attach_file(file_path(m_persistent.dirname, "count"));
+		}
+	}
+
+	const semidynamic_compact_index::size_type semidynamic_compact_index::ignored_byte;
+
+	void semidynamic_compact_index::append_file(const char *filename, const std::vector<size_type> &alphabet_map){
+		if(alphabet_map.size() != 256){
+			throw std::invalid_argument("semidynamic_compact_index::append_file");
+		}
+		::sdci::detail::block_reader reader(filename, append_block_size);
+		append_blocks(reader, alphabet_map);
+	}
+
+	void semidynamic_compact_index::append_fd(int fd, const std::vector<size_type> &alphabet_map){
+		if(alphabet_map.size() != 256){
+			throw std::invalid_argument("semidynamic_compact_index::append_fd");
+		}
+		::sdci::detail::block_reader reader(fd, append_block_size);
+		append_blocks(reader, alphabet_map);
+	}
+
+	// The blocks are translated and appended while the reader reads the next block.
+	void semidynamic_compact_index::append_blocks(
+		::sdci::detail::block_reader &reader, const std::vector<size_type> &alphabet_map
+	){
+		if(reader.expected_size() != 0 && m_sigma != 0){
+			reserve(m_textlen + reader.expected_size());
+		}
+		std::vector<encode_type> block;
+		block.reserve(append_block_size);
+		const char *data = 0;
+		size_type size = 0;
+		while(reader.next(data, size)){
+			block.clear();
+			for(size_type i = 0; i < size; ++i){
+				const size_type ch = alphabet_map[static_cast<unsigned char>(data[i])];
+				if(ch != ignored_byte){
+					block.push_back(ch);
+				}
+			}
+			append(block.begin(), block.end());
+		}
 	}
 
 	void semidynamic_compact_index::swap(semidynamic_compact_index &other){
@@ -134,13 +418,39 @@ namespace sdci{
 		std::swap(m_last_qgram, other.m_last_qgram);
 		std::swap(m_next_sampling_pos, other.m_next_sampling_pos);
 		std::swap(m_first_appearance, other.m_first_appearance);
+		std::swap(m_fast_count, other.m_fast_count);
+		std::swap(m_sparse_directory, other.m_sparse_directory);
+		std::swap(m_compact_directory, other.m_compact_directory);
+		std::swap(m_mapped, other.m_mapped);
+		std::swap(m_shift_encoding, other.m_shift_encoding);
+		std::swap(m_lg_sigma, other.m_lg_sigma);
+		m_pow_sigma.swap(other.m_pow_sigma);
 		m_list_sampled.swap(other.m_list_sampled);
 		m_efirst.swap(other.m_efirst);
 		m_enext.swap(other.m_enext);
 		m_encQ.swap(other.m_encQ);
+		m_sparse_qgrams.swap(other.m_sparse_qgrams);
+		m_qgram_ranks.swap(other.m_qgram_ranks);
+		m_qgram_count.swap(other.m_qgram_count);
+		m_persistent.swap(other.m_persistent);
+	}
+
+	void semidynamic_compact_index::set_encoding(){
+		m_lg_sigma = m_sigma != 0 ? ::sdci::detail::ceillg64(m_sigma) : 0;
+		m_shift_encoding = m_sigma != 0 && (size_type(1) << m_lg_sigma) == m_sigma;
 	}
 
 	void semidynamic_compact_index::clear(){
+		if(m_mapped){
+			initialize(m_sigma, m_param_q, m_param_k);
+			return;
+		}
+		if(m_compact_directory){
+			compact_directory(false);
+		}
+		if(persistent()){
+			mark_dirty();
+		}
 		if(m_textlen >= m_param_q){
 			if(m_textlen > m_param_q){
 				m_efirst.fill0();
@@ -148,12 +458,725 @@ namespace sdci{
 			}
 			m_list_sampled.clear();
 			m_encQ.clear();
+			m_sparse_qgrams.clear();
+			m_qgram_count.clear();
 		}
 
 		m_textlen = 0;
 		m_last_qgram = 0;
 		m_next_sampling_pos = m_param_q;
 		m_first_appearance = false;
+		if(persistent()){
+			// the text log is overwritten by the following appends
+			sync();
+		}
+	}
+
+	semidynamic_compact_index::size_type
+	semidynamic_compact_index::distinct_qgrams_encoded(encode_type ptn_enc, size_type ptn_len) const{
+		if(m_textlen < m_param_q){
+			return 0;
+		}
+		const size_type difflen = m_param_q - ptn_len;
+		const encode_type ptn_first = lshift(ptn_enc, difflen);
+		const encode_type ptn_last = lshift(ptn_enc + 1, difflen);
+		if(m_sparse_directory){
+			return m_sparse_qgrams.rank(ptn_last) - m_sparse_qgrams.rank(ptn_first);
+		}
+		if(m_encQ.rank_enabled()){
+			return m_encQ.rank(ptn_last) - m_encQ.rank(ptn_first);
+		}
+		size_type ret = 0;
+		qgram_iterator qgrams(*this, ptn_first, ptn_last);
+		for(size_type p = 0; qgrams.next(p); ){
+			++ret;
+		}
+		return ret;
+	}
+
+	semidynamic_compact_index::size_type
+	semidynamic_compact_index::count_encoded(encode_type ptn_enc, size_type ptn_len) const{
+		if(!m_fast_count || m_textlen < m_param_q){
+			return locate_encoded(ptn_enc, ptn_len, ::sdci::detail::count_iterator()).count();
+		}
+
+		const size_type difflen = m_param_q - ptn_len;
+		const encode_type ptn_first = lshift(ptn_enc, difflen);
+		const encode_type ptn_last = lshift(ptn_enc + 1, difflen);
+		size_type ret = m_qgram_count.range_sum(ptn_first, ptn_last);
+
+		// occurrences starting in the last (q-1) characters
+		for(size_type i = 1; i <= difflen; ++i){
+			if(mask(rshift(m_last_qgram, difflen - i), ptn_len) == ptn_enc){
+				++ret;
+			}
+		}
+		return ret;
+	}
+
+	semidynamic_compact_index::size_type
+	semidynamic_compact_index::count(const class_pattern &pattern) const{
+		if(!m_fast_count || m_textlen < m_param_q || pattern.empty()){
+			return locate(pattern, ::sdci::detail::count_iterator()).count();
+		}
+		if(pattern.size() > max_pattern_size()){
+			ptnlenerr();
+		}
+
+		std::vector<qgram_range> ranges;
+		collect_class_ranges(pattern, 0, 0, ranges);
+		size_type ret = 0;
+		for(size_type r = 0; r < ranges.size(); ++r){
+			ret += m_qgram_count.range_sum(ranges[r].first, ranges[r].last);
+		}
+
+		// occurrences starting in the last (q-1) characters
+		for(size_type i = 1; i + pattern.size() <= m_param_q; ++i){
+			if(class_matches(pattern, mask(m_last_qgram, m_param_q - i), m_param_q - i)){
+				++ret;
+			}
+		}
+		return ret;
+	}
+
+	// Sets the column of depth 0, where the text is empty.
+	void semidynamic_compact_index::start_approx_search(approx_search &search) const{
+		const size_type len = search.pattern.size();
+		// for hamming_distance, the text must still be as long as the pattern (every q-gram is)
+		search.empty_admitted = (search.max_distance >= len);
+		if(search.distance == hamming_distance){
+			search.max_depth = len;
+			search.columns.assign(len + 1, 0);
+			return;
+		}
+		if(!search.empty_admitted && len + search.max_distance > max_pattern_size()){
+			ptnlenerr();
+		}
+		// a text longer than the pattern by more than max_distance is never admitted
+		search.max_depth = len + std::min(search.max_distance, len);
+		search.columns.resize((search.max_depth + 1) * (len + 1));
+		for(size_type i = 0; i <= len; ++i){
+			search.columns[i] = i;
+		}
+	}
+
+	/*
+		Computes the column of depth+1 from that of depth, where ch is the (depth+1)-th character of the text.
+		Returns approx_admit if the text is within the distance (and so are all its extensions),
+		approx_prune if no extension of it is, and approx_descend otherwise.
+	*/
+	semidynamic_compact_index::approx_state
+	semidynamic_compact_index::approx_step(approx_search &search, size_type depth, encode_type ch) const{
+		const size_type len = search.pattern.size();
+		if(search.distance == hamming_distance){
+			const size_type mismatches = search.columns[depth] + (ch != search.pattern[depth]);
+			search.columns[depth + 1] = mismatches;
+			if(mismatches > search.max_distance){
+				return approx_prune;
+			}
+			// admitted when even the remaining characters all mismatch
+			return mismatches + (len - depth - 1) <= search.max_distance ? approx_admit : approx_descend;
+		}
+
+		const size_type *column = &search.columns[depth * (len + 1)];
+		size_type *next = &search.columns[(depth + 1) * (len + 1)];
+		next[0] = depth + 1;
+		size_type lowest = next[0];
+		for(size_type i = 1; i <= len; ++i){
+			next[i] = std::min(std::min(column[i], next[i - 1]) + 1, column[i - 1] + (ch != search.pattern[i - 1]));
+			lowest = std::min(lowest, next[i]);
+		}
+		if(next[len] <= search.max_distance){
+			return approx_admit;
+		}
+		if(lowest > search.max_distance || depth + 1 == search.max_depth){
+			return approx_prune;
+		}
+		return approx_descend;
+	}
+
+	// Returns whether a prefix of str (a string of len characters) is within the distance.
+	bool semidynamic_compact_index::approx_prefix_matches(approx_search &search, encode_type str, size_type len) const{
+		if(search.distance == hamming_distance && len < search.pattern.size()){
+			return false;
+		}
+		if(search.empty_admitted){
+			return true;
+		}
+		for(size_type depth = 0; depth < len; ++depth){
+			const approx_state state = approx_step(search, depth, mask(rshift(str, len - depth - 1), 1));
+			if(state != approx_descend){
+				return state == approx_admit;
+			}
+		}
+		return false;
+	}
+
+	// Computes the disjoint ranges of the q-grams of the text admitted by the search, in ascending order.
+	void semidynamic_compact_index::collect_approx_ranges(approx_search &search, std::vector<qgram_range> &ranges) const{
+		if(search.empty_admitted){
+			const qgram_range all = {0, m_pow_sigma.back()};
+			ranges.push_back(all);
+			return;
+		}
+		collect_approx_ranges(search, 0, 0, ranges);
+	}
+
+	/*
+		Appends the ranges admitted among the q-grams with prefix (of depth characters) as prefix.
+		Only the characters following prefix in the q-grams of the text are tried,
+		by looking up the next q-gram after each of them.
+		For hamming_distance, a prefix with max_distance mismatches is extended by the rest of the pattern at once.
+	*/
+	void semidynamic_compact_index::collect_approx_ranges
+	(approx_search &search, encode_type prefix, size_type depth, std::vector<qgram_range> &ranges) const
+	{
+		const size_type rest = m_param_q - depth - 1;
+		encode_type first = lshift(prefix, rest + 1);
+		const encode_type last = lshift(prefix + 1, rest + 1);
+		size_type qgram = 0;
+		while(first < last){
+			qgram_iterator qgrams(*this, first, last);
+			if(!qgrams.next(qgram)){
+				break;
+			}
+			const encode_type child = rshift(qgram, rest);
+			const qgram_range range = {lshift(child, rest), lshift(child + 1, rest)};
+			const approx_state state = approx_step(search, depth, mask(child, 1));
+			if(state == approx_admit){
+				ranges.push_back(range);
+			}
+			else if(state == approx_descend && search.distance == hamming_distance &&
+				search.columns[depth + 1] == search.max_distance
+			){
+				// the remaining characters must match, so the range is made at once
+				const size_type len = search.pattern.size();
+				encode_type extended = child;
+				size_type i = depth + 1;
+				for(; i < len && search.pattern[i] < m_sigma; ++i){
+					extended = lshift(extended, 1) + search.pattern[i];
+				}
+				if(i == len){
+					const qgram_range exact = {lshift(extended, m_param_q - len), lshift(extended + 1, m_param_q - len)};
+					ranges.push_back(exact);
+				}
+			}
+			else if(state == approx_descend){
+				collect_approx_ranges(search, child, depth + 1, ranges);
+			}
+			first = range.last;
+		}
+	}
+
+	// Returns whether the first characters of str (a string of len characters) match the pattern.
+	bool semidynamic_compact_index::class_matches(const class_pattern &pattern, encode_type str, size_type len) const{
+		if(len < pattern.size()){
+			return false;
+		}
+		for(size_type i = 0; i < pattern.size(); ++i){
+			const size_type ch = mask(rshift(str, len - i - 1), 1);
+			if(!pattern.any(i) && !std::binary_search(pattern.chars_begin(i), pattern.chars_end(i), ch)){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*
+		Appends the ranges of the q-grams with prefix (of depth characters) as prefix
+		which match the pattern, in ascending order.
+		The following single characters extend prefix without looking up the q-grams,
+		and once only don't-cares remain, the whole range of prefix is taken.
+		Otherwise the next q-gram is looked up for each character of the class,
+		and the characters which no q-gram of the text has there are skipped.
+	*/
+	void semidynamic_compact_index::collect_class_ranges
+	(const class_pattern &pattern, encode_type prefix, size_type depth, std::vector<qgram_range> &ranges) const
+	{
+		const size_type len = pattern.size();
+		for(; depth < len && !pattern.any(depth) && pattern.chars_end(depth) - pattern.chars_begin(depth) == 1; ++depth){
+			const size_type ch = *pattern.chars_begin(depth);
+			if(ch >= m_sigma){
+				return;
+			}
+			prefix = lshift(prefix, 1) + ch;
+		}
+		size_type fixed = depth;
+		while(fixed < len && pattern.any(fixed)){
+			++fixed;
+		}
+		if(fixed == len){
+			const qgram_range range = {lshift(prefix, m_param_q - depth), lshift(prefix + 1, m_param_q - depth)};
+			ranges.push_back(range);
+			return;
+		}
+
+		const size_type rest = m_param_q - depth - 1;
+		const encode_type last = lshift(prefix + 1, rest + 1);
+		const bool any = pattern.any(depth);
+		const size_type *chars = pattern.chars_begin(depth);
+		const size_type *chars_end = std::lower_bound(chars, pattern.chars_end(depth), m_sigma);
+		size_type qgram = 0;
+		size_type ch = 0;
+		while(true){
+			if(!any){
+				if(chars == chars_end){
+					break;
+				}
+				ch = *chars;
+			}
+			else if(ch == m_sigma){
+				break;
+			}
+			qgram_iterator qgrams(*this, lshift(lshift(prefix, 1) + ch, rest), last);
+			if(!qgrams.next(qgram)){
+				break;
+			}
+			const encode_type child = rshift(qgram, rest);
+			const size_type found = mask(child, 1);
+			if(any){
+				collect_class_ranges(pattern, child, depth + 1, ranges);
+				ch = found + 1;
+			}
+			else if(found == ch){
+				collect_class_ranges(pattern, child, depth + 1, ranges);
+				++chars;
+			}
+			else{
+				chars = std::lower_bound(chars, chars_end, found);
+			}
+		}
+	}
+
+	namespace{
+		// orders ranges by their first q-grams, and nesting ranges before nested ones
+		struct batch_range_less{
+			template <class Range>
+			bool operator() (const std::pair<Range, std::size_t> &a, const std::pair<Range, std::size_t> &b) const{
+				return a.first.first < b.first.first ||
+					(a.first.first == b.first.first && a.first.last > b.first.last);
+			}
+		};
+	}
+
+	/*
+		Computes the distinct ranges of q-grams which have the patterns as prefixes,
+		sorted so that a range comes before the ranges nested in it.
+		The patterns which cannot occur get zero length,
+		and for the others, the index of their range is set.
+		If the text is shorter than q, no range is made.
+	*/
+	void semidynamic_compact_index::make_batch_ranges
+	(std::vector<batch_pattern> &patterns, std::vector<qgram_range> &ranges) const
+	{
+		typedef std::pair<qgram_range, size_type> range_with_id;
+		std::vector<range_with_id> tmp;
+		for(size_type i = 0; i < patterns.size(); ++i){
+			batch_pattern &ptn = patterns[i];
+			ptn.range = size_type(-1);
+			if(ptn.len > m_textlen){
+				ptn.len = 0;
+			}
+			if(ptn.len == 0 || m_textlen < m_param_q){
+				continue;
+			}
+			const size_type difflen = m_param_q - ptn.len;
+			range_with_id r;
+			r.first.first = lshift(ptn.enc, difflen);
+			r.first.last = lshift(ptn.enc + 1, difflen);
+			r.second = i;
+			tmp.push_back(r);
+		}
+
+		std::sort(tmp.begin(), tmp.end(), batch_range_less());
+
+		ranges.clear();
+		for(size_type i = 0; i < tmp.size(); ++i){
+			const qgram_range &r = tmp[i].first;
+			if(ranges.empty() || ranges.back().first != r.first || ranges.back().last != r.last){
+				ranges.push_back(r);
+			}
+			patterns[tmp[i].second].range = ranges.size() - 1;
+		}
+	}
+
+	/*
+		Scans the q-grams in the union of ranges once,
+		and adds the occurrences derived from each q-gram
+		to the results of all ranges containing it.
+		Since two ranges are either disjoint or nested,
+		the ranges containing the current q-gram form a stack.
+	*/
+	void semidynamic_compact_index::sweep_batch
+	(
+		const std::vector<qgram_range> &ranges,
+		std::vector<std::vector<size_type> > *occ_results, std::vector<size_type> *count_results
+	) const
+	{
+		if(ranges.empty()){
+			return;
+		}
+
+		std::vector<size_type> active;
+		std::vector<encode_type> frontier;
+		std::vector<size_type> found;
+		size_type next_range = 0;
+		// p == kinds_of_qgrams once the q-grams are exhausted
+		const size_type kinds_of_qgrams = m_pow_sigma.back();
+		qgram_iterator qgrams(*this, ranges[0].first, kinds_of_qgrams);
+		size_type p = 0;
+		if(!qgrams.next(p)){
+			p = kinds_of_qgrams;
+		}
+
+		while(true){
+			const bool leave = !active.empty() && ranges[active.back()].last <= p;
+			const bool enter = next_range < ranges.size() && ranges[next_range].first <= p;
+			if(leave || enter || frontier.size() == locate_batch_size){
+				// the occurrences in frontier belong to all active ranges
+				if(occ_results != 0){
+					found.clear();
+					locate_frontier(frontier, 0, std::back_inserter(found));
+					for(size_type i = 0; i < active.size(); ++i){
+						std::vector<size_type> &occ = (*occ_results)[active[i]];
+						occ.insert(occ.end(), found.begin(), found.end());
+					}
+				}
+				else{
+					const size_type cnt =
+						locate_frontier(frontier, 0, ::sdci::detail::count_iterator()).count();
+					for(size_type i = 0; i < active.size(); ++i){
+						(*count_results)[active[i]] += cnt;
+					}
+				}
+			}
+
+			while(!active.empty() && ranges[active.back()].last <= p){
+				active.pop_back();
+			}
+			for(; next_range < ranges.size() && ranges[next_range].first <= p; ++next_range){
+				if(p < ranges[next_range].last){
+					active.push_back(next_range);
+				}
+			}
+
+			if(active.empty()){
+				if(next_range == ranges.size()){
+					break;
+				}
+				qgrams = qgram_iterator(*this, ranges[next_range].first, kinds_of_qgrams);
+				if(!qgrams.next(p)){
+					p = kinds_of_qgrams;
+				}
+				continue;
+			}
+
+			frontier.push_back(p);
+			if(!qgrams.next(p)){
+				p = kinds_of_qgrams;
+			}
+		}
+	}
+
+	unsigned semidynamic_compact_index::hardware_threads(){
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	/*
+		Calls task(0), ..., task(num_tasks-1) on separate threads and waits for them.
+		If some of them throw exceptions, one of the exceptions is rethrown.
+	*/
+	void semidynamic_compact_index::run_parallel
+	(size_type num_tasks, const std::function<void(size_type)> &task){
+		std::exception_ptr error;
+		std::mutex error_mtx;
+		const auto run = [&](size_type i){
+			try{
+				task(i);
+			}
+			catch(...){
+				std::lock_guard<std::mutex> lock(error_mtx);
+				if(!error){
+					error = std::current_exception();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		try{
+			for(size_type i = 1; i < num_tasks; ++i){
+				threads.push_back(std::thread(run, i));
+			}
+		}
+		catch(...){
+			for(size_type i = 0; i < threads.size(); ++i){
+				threads[i].join();
+			}
+			throw;
+		}
+		run(0);
+		for(size_type i = 0; i < threads.size(); ++i){
+			threads[i].join();
+		}
+		if(error){
+			std::rethrow_exception(error);
+		}
+	}
+
+	namespace{
+		/*
+			A task of parallel locating: either the q-grams in [first, last) with their descendants,
+			or the q-gram first of depth offset with its descendants.
+		*/
+		struct parallel_task{
+			::sdci::detail::uint64_type first;
+			::sdci::detail::uint64_type last;
+			std::size_t offset;
+			bool subtree;
+		};
+	}
+
+	void semidynamic_compact_index::locate_parallel_encoded
+	(encode_type ptn_enc, size_type ptn_len, std::vector<size_type> &result, unsigned num_threads) const
+	{
+		if(num_threads == 0){
+			num_threads = hardware_threads();
+		}
+		if(ptn_len > m_textlen){
+			return;
+		}
+		if(num_threads == 1 || m_textlen < m_param_q){
+			locate_encoded(ptn_enc, ptn_len, std::back_inserter(result));
+			return;
+		}
+
+		const size_type difflen = m_param_q - ptn_len;
+		const encode_type ptn_first = lshift(ptn_enc, difflen);
+		const encode_type ptn_last = lshift(ptn_enc + 1, difflen);
+		const size_type min_tasks = num_threads * 16;
+		::sdci::detail::work_stealing_queue<parallel_task> queues(num_threads);
+		encode_type grain = 1;
+
+		// with the rank directory, the decision and the division are by the number of q-grams present
+		const bool ranked = !m_sparse_directory && m_encQ.rank_enabled();
+		const size_type rank_first = ranked ? m_encQ.rank(ptn_first) : 0;
+		const size_type present = ranked ? m_encQ.rank(ptn_last) - rank_first : ptn_last - ptn_first;
+
+		if(present >= min_tasks){
+			// ranges are halved on demand, so that the halves can be stolen
+			const encode_type width = ptn_last - ptn_first;
+			grain = std::max<encode_type>(1, width / (num_threads * 64));
+			encode_type bound = ptn_first;
+			for(size_type i = 0; i < num_threads; ++i){
+				const encode_type next_bound = (i + 1 == num_threads ? ptn_last :
+					ranked ? encode_type(m_encQ.select(rank_first + present * (i + 1) / num_threads)) :
+					ptn_first + width * (i + 1) / num_threads
+				);
+				const parallel_task task = {bound, next_bound, 0, false};
+				queues.push(i, task);
+				bound = next_bound;
+			}
+		}
+		else{
+			// a few q-grams: split their subtrees until there are enough tasks
+			std::vector<encode_type> frontier;
+			qgram_iterator qgrams(*this, ptn_first, ptn_last);
+			for(size_type p = 0; qgrams.next(p); ){
+				frontier.push_back(p);
+			}
+			size_type offset = 0;
+			for(; !frontier.empty() && frontier.size() < min_tasks && offset < m_param_k - 1; ++offset){
+				locate_frontier(frontier, offset, std::back_inserter(result), offset + 1);
+			}
+			for(size_type i = 0; i < frontier.size(); ++i){
+				const parallel_task task = {frontier[i], 0, offset, true};
+				queues.push(i % num_threads, task);
+			}
+		}
+
+		std::vector<std::vector<size_type> > outputs(num_threads);
+		std::atomic<bool> failed(false);
+		std::exception_ptr error;
+		std::mutex error_mtx;
+
+		const auto worker = [&](size_type id){
+			try{
+				std::vector<size_type> &out = outputs[id];
+				std::vector<encode_type> frontier;
+				parallel_task task;
+				while(!failed.load()){
+					if(!queues.pop(id, task)){
+						if(queues.finished()){
+							break;
+						}
+						std::this_thread::yield();
+						continue;
+					}
+
+					if(task.subtree){
+						frontier.assign(1, task.first);
+						locate_frontier(frontier, task.offset, std::back_inserter(out));
+					}
+					else{
+						encode_type first = task.first;
+						encode_type last = task.last;
+						while(last - first > grain){
+							const encode_type mid = first + (last - first) / 2;
+							const parallel_task rest = {mid, last, 0, false};
+							queues.push(id, rest);
+							last = mid;
+						}
+						qgram_iterator qgrams(*this, first, last);
+						for(size_type p = 0; qgrams.next(p); ){
+							frontier.push_back(p);
+							if(frontier.size() == locate_batch_size){
+								locate_frontier(frontier, 0, std::back_inserter(out));
+							}
+						}
+						locate_frontier(frontier, 0, std::back_inserter(out));
+					}
+					queues.done();
+				}
+			}
+			catch(...){
+				std::lock_guard<std::mutex> lock(error_mtx);
+				if(!error){
+					error = std::current_exception();
+				}
+				failed.store(true);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		try{
+			for(size_type i = 0; i < num_threads; ++i){
+				threads.push_back(std::thread(worker, i));
+			}
+		}
+		catch(...){
+			failed.store(true);
+			for(size_type i = 0; i < threads.size(); ++i){
+				threads[i].join();
+			}
+			throw;
+		}
+		for(size_type i = 0; i < num_threads; ++i){
+			threads[i].join();
+		}
+		if(error){
+			std::rethrow_exception(error);
+		}
+
+		size_type total = result.size();
+		for(size_type i = 0; i < num_threads; ++i){
+			total += outputs[i].size();
+		}
+		result.reserve(total);
+		for(size_type i = 0; i < num_threads; ++i){
+			result.insert(result.end(), outputs[i].begin(), outputs[i].end());
+			std::vector<size_type>().swap(outputs[i]);
+		}
+		locate_tail(ptn_enc, ptn_len, std::back_inserter(result));
+	}
+
+	semidynamic_compact_index::occurrence_cursor::occurrence_cursor()
+	: m_index(0), m_phase(phase_done), m_ptn_enc(), m_ptn_len(), m_qgrams(), m_tail_pos()
+	{
+	}
+
+	semidynamic_compact_index::occurrence_cursor::occurrence_cursor
+	(const semidynamic_compact_index &index, encode_type pattern, size_type length)
+	: m_index(&index), m_phase(phase_qgrams), m_ptn_enc(pattern), m_ptn_len(length),
+	  m_qgrams(), m_tail_pos()
+	{
+		if(index.m_textlen < index.m_param_q){
+			m_phase = phase_short_text;
+			return;
+		}
+		const size_type difflen = index.m_param_q - length;
+		m_qgrams = qgram_iterator(index, index.lshift(pattern, difflen), index.lshift(pattern + 1, difflen));
+		m_stack.reserve(index.m_param_k);
+	}
+
+	void semidynamic_compact_index::occurrence_cursor::push(encode_type qgram, size_type offset){
+		frame f;
+		f.qgram = qgram;
+		f.offset = offset;
+		const size_type slot = m_index->qgram_slot(qgram);
+		f.node = m_index->m_list_sampled.first_node(slot);
+		f.edge = (offset < m_index->m_param_k - 1 ? m_index->m_efirst.get(slot) : 0);
+		m_stack.push_back(f);
+	}
+
+	// The traversal is the same as locate() and locate_dfs().
+	bool semidynamic_compact_index::occurrence_cursor::next(size_type &pos){
+		if(m_phase == phase_done){ // e.g. a cursor made by default, which has no index
+			return false;
+		}
+		const semidynamic_compact_index &idx = *m_index;
+
+		while(m_phase != phase_done){
+			if(!m_stack.empty()){
+				frame &f = m_stack.back();
+				if(f.node != ::sdci::detail::sampled_position_list::npos){
+					pos = f.node * idx.m_param_k + f.offset;
+					f.node = idx.m_list_sampled.next_node(f.node);
+					return true;
+				}
+				if(f.edge != 0){
+					const encode_type child =
+						idx.rshift(f.qgram, 1) + idx.lshift(f.edge - 1, idx.m_param_q - 1);
+					const size_type offset = f.offset + 1;
+					f.edge = idx.m_enext.get(idx.qgram_slot(child));
+					push(child, offset);
+					continue;
+				}
+				m_stack.pop_back();
+				continue;
+			}
+
+			if(m_phase == phase_short_text){
+				const size_type num_cand = idx.m_textlen - m_ptn_len;
+				while(m_tail_pos <= num_cand){
+					const size_type i = m_tail_pos++;
+					if(idx.mask(idx.rshift(idx.m_last_qgram, num_cand - i), m_ptn_len) == m_ptn_enc){
+						pos = i;
+						return true;
+					}
+				}
+				m_phase = phase_done;
+			}
+			else if(m_phase == phase_qgrams){
+				size_type qgram = 0;
+				if(m_qgrams.next(qgram)){
+					push(qgram, 0);
+				}
+				else{
+					m_phase = phase_tail;
+					m_tail_pos = 1;
+				}
+			}
+			else{
+				const size_type difflen = idx.m_param_q - m_ptn_len;
+				const size_type covered = ((idx.m_textlen - idx.m_param_q) / idx.m_param_k + 1) * idx.m_param_k;
+				const size_type offset = idx.m_textlen - idx.m_param_q;
+				if(m_tail_pos > difflen){
+					m_phase = phase_done;
+					continue;
+				}
+				const size_type i = m_tail_pos++;
+				if(idx.mask(idx.rshift(idx.m_last_qgram, difflen - i), m_ptn_len) == m_ptn_enc){
+					if(i + offset >= covered){
+						pos = i + offset;
+						return true;
+					}
+					else if(idx.m_first_appearance){
+						push(idx.m_last_qgram, i);
+					}
+				}
+			}
+		}
+		return false;
 	}
 
 	void semidynamic_compact_index::invalidarg(encode_type value) const{
@@ -170,23 +1193,88 @@ namespace sdci{
 		throw std::length_error(errmsg.str());
 	}
 
+	void semidynamic_compact_index::detach_arrays(){
+		m_list_sampled.detach();
+		m_efirst.detach();
+		m_enext.detach();
+		m_encQ.detach();
+		m_sparse_qgrams.detach();
+		m_qgram_ranks.detach();
+		m_qgram_count.detach();
+		m_mapped = false;
+	}
+
+	void semidynamic_compact_index::release_arrays(){
+		::sdci::detail::sampled_position_list().swap(m_list_sampled);
+		::sdci::detail::packed_array().swap(m_efirst);
+		::sdci::detail::packed_array().swap(m_enext);
+		::sdci::detail::integer_set().swap(m_encQ);
+		::sdci::detail::sparse_qgram_map().swap(m_sparse_qgrams);
+		::sdci::detail::packed_array().swap(m_qgram_ranks);
+		::sdci::detail::prefix_sum_array().swap(m_qgram_count);
+		m_mapped = false;
+	}
+
+	namespace{
+		// The header of saved index consists of sizeof(size_type) in the lower 16 bits
+		// and the format version in the upper bits.
+		// Version 0 has no fast counting data.
+		// Since version 2, every field takes a multiple of 8 bytes,
+		// so that the arrays are aligned and can be mapped by map_file().
+		// Version 3 adds the sparse directory of q-grams after the fast counting data.
+		// Version 4 adds the ranks of the compact directory of q-grams after the sparse directory.
+		const unsigned format_version = 4;
+
+		void write_flag(std::ostream &stream, bool flag){
+			const ::sdci::detail::uint64_type value = flag;
+			::sdci::detail::write_data(stream, &value);
+		}
+
+		bool read_flag(std::istream &stream, unsigned version){
+			if(version >= 2){
+				::sdci::detail::uint64_type value = 0;
+				::sdci::detail::read_data(stream, &value);
+				return value != 0;
+			}
+			char value = 0;
+			::sdci::detail::read_data(stream, &value);
+			return value != 0;
+		}
+	}
+
 	void semidynamic_compact_index::save_stream(std::ostream &stream) const{
-		unsigned size_type_size = sizeof(size_type);
-		::sdci::detail::write_data(stream, &size_type_size);
+		unsigned header = sizeof(size_type) | format_version << 16;
+		const unsigned padding = 0;
+		::sdci::detail::write_data(stream, &header);
+		::sdci::detail::write_data(stream, &padding);
 		::sdci::detail::write_data(stream, &m_sigma);
 		::sdci::detail::write_data(stream, &m_param_q);
 		::sdci::detail::write_data(stream, &m_param_k);
 		::sdci::detail::write_data(stream, &m_textlen);
 		::sdci::detail::write_data(stream, &m_last_qgram);
 		::sdci::detail::write_data(stream, &m_next_sampling_pos);
-		const char first_appearance = m_first_appearance;
-		::sdci::detail::write_data(stream, &first_appearance);
+		write_flag(stream, m_first_appearance);
 		::sdci::detail::write_vector(stream, m_pow_sigma);
 		
 		m_list_sampled.save_stream(stream);
 		m_efirst.save_stream(stream);
 		m_enext.save_stream(stream);
 		m_encQ.save_stream(stream);
+
+		write_flag(stream, m_fast_count);
+		if(m_fast_count){
+			m_qgram_count.save_stream(stream);
+		}
+
+		write_flag(stream, m_sparse_directory);
+		if(m_sparse_directory){
+			m_sparse_qgrams.save_stream(stream);
+		}
+
+		write_flag(stream, m_compact_directory);
+		if(m_compact_directory){
+			m_qgram_ranks.save_stream(stream);
+		}
 	}
 
 	void semidynamic_compact_index::save_file(const char *filename) const{
@@ -198,11 +1286,20 @@ namespace sdci{
 	}
 
 	void semidynamic_compact_index::load_stream(std::istream &stream) try{
-		unsigned size_type_size = 0;
-		::sdci::detail::read_data(stream, &size_type_size);
-		if(size_type_size != sizeof(size_type)){
+		release_persistent();
+		if(m_mapped){
+			release_arrays();
+		}
+		unsigned header = 0;
+		::sdci::detail::read_data(stream, &header);
+		const unsigned version = header >> 16;
+		if((header & 0xFFFF) != sizeof(size_type) || version > format_version){
 			::sdci::detail::formaterr();
 		}
+		if(version >= 2){
+			unsigned padding = 0;
+			::sdci::detail::read_data(stream, &padding);
+		}
 		
 		::sdci::detail::read_data(stream, &m_sigma);
 		::sdci::detail::read_data(stream, &m_param_q);
@@ -211,17 +1308,42 @@ namespace sdci{
 		::sdci::detail::read_data(stream, &m_last_qgram);
 		::sdci::detail::read_data(stream, &m_next_sampling_pos);
 		
-		char first_appearance = 0;
-		::sdci::detail::read_data(stream, &first_appearance);
-		m_first_appearance = first_appearance;
+		m_first_appearance = read_flag(stream, version);
 		::sdci::detail::read_vector(stream, m_pow_sigma);
+		set_encoding();
 		
 		m_list_sampled.load_stream(stream);
 		m_efirst.load_stream(stream);
 		m_enext.load_stream(stream);
 		m_encQ.load_stream(stream);
+
+		m_fast_count = version >= 1 && read_flag(stream, version);
+		if(m_fast_count){
+			m_qgram_count.load_stream(stream);
+		}
+		else{
+			::sdci::detail::prefix_sum_array().swap(m_qgram_count);
+		}
+
+		m_sparse_directory = version >= 3 && read_flag(stream, version);
+		if(m_sparse_directory){
+			m_sparse_qgrams.load_stream(stream);
+		}
+		else{
+			::sdci::detail::sparse_qgram_map().swap(m_sparse_qgrams);
+		}
+
+		m_compact_directory = version >= 4 && read_flag(stream, version);
+		if(m_compact_directory){
+			m_qgram_ranks.load_stream(stream);
+		}
+		else{
+			::sdci::detail::packed_array().swap(m_qgram_ranks);
+		}
 	}
 	catch(...){
+		m_fast_count = false;
+		m_sparse_directory = false;
 		initialize(0, 0, 0);
 		throw;
 	}
@@ -233,7 +1355,353 @@ namespace sdci{
 		}
 		load_stream(stream);
 	}
-}
 
+	void semidynamic_compact_index::map_file(const char *filename, const map_options &options) try{
+		release_persistent();
+		if(m_mapped){
+			release_arrays();
+		}
+		const std::shared_ptr<const ::sdci::detail::mapped_file> file =
+			std::make_shared< ::sdci::detail::mapped_file>(filename, options);
+		::sdci::detail::mapped_reader reader(file->data(), file->data() + file->size(), file);
 
+		unsigned header = 0;
+		reader.read(&header);
+		const unsigned version = header >> 16;
+		if((header & 0xFFFF) != sizeof(size_type) || version > format_version){
+			::sdci::detail::formaterr();
+		}
+		if(version < 2){
+			// the arrays are not aligned in older formats
+			load_file(filename);
+			return;
+		}
+		unsigned padding = 0;
+		reader.read(&padding);
+
+		reader.read(&m_sigma);
+		reader.read(&m_param_q);
+		reader.read(&m_param_k);
+		reader.read(&m_textlen);
+		reader.read(&m_last_qgram);
+		reader.read(&m_next_sampling_pos);
+		::sdci::detail::uint64_type flag = 0;
+		reader.read(&flag);
+		m_first_appearance = flag != 0;
+		reader.read_vector(m_pow_sigma);
+		set_encoding();
+
+		m_list_sampled.map_memory(reader);
+		m_efirst.map_memory(reader);
+		m_enext.map_memory(reader);
+		m_encQ.map_memory(reader);
+
+		reader.read(&flag);
+		m_fast_count = flag != 0;
+		if(m_fast_count){
+			m_qgram_count.map_memory(reader);
+		}
+		else{
+			::sdci::detail::prefix_sum_array().swap(m_qgram_count);
+		}
+
+		flag = 0;
+		if(version >= 3){
+			reader.read(&flag);
+		}
+		m_sparse_directory = flag != 0;
+		if(m_sparse_directory){
+			m_sparse_qgrams.map_memory(reader);
+		}
+		else{
+			::sdci::detail::sparse_qgram_map().swap(m_sparse_qgrams);
+		}
 
+		flag = 0;
+		if(version >= 4){
+			reader.read(&flag);
+		}
+		m_compact_directory = flag != 0;
+		if(m_compact_directory){
+			m_qgram_ranks.map_memory(reader);
+		}
+		else{
+			::sdci::detail::packed_array().swap(m_qgram_ranks);
+		}
+		m_mapped = true;
+	}
+	catch(...){
+		release_arrays();
+		m_fast_count = false;
+		m_sparse_directory = false;
+		initialize(0, 0, 0);
+		throw;
+	}
+
+	semidynamic_compact_index::persistent_state::persistent_state()
+	: dirty(false)
+	{
+	}
+
+	semidynamic_compact_index::persistent_state::persistent_state(const persistent_state &)
+	: dirty(false)
+	{
+	}
+
+	semidynamic_compact_index::persistent_state&
+	semidynamic_compact_index::persistent_state::operator= (const persistent_state &other){
+		if(this != &other){
+			persistent_state().swap(*this);
+		}
+		return *this;
+	}
+
+	void semidynamic_compact_index::persistent_state::swap(persistent_state &other){
+		dirname.swap(other.dirname);
+		meta.swap(other.meta);
+		std::swap(dirty, other.dirty);
+		text.swap(other.text);
+	}
+
+	namespace{
+		// The meta file of a persistent index has the same header as saved index,
+		// followed by the flag of modification since the last sync.
+		// Version 2 adds the flag of the sparse directory of q-grams after the flag of the fast counting mode.
+		const unsigned persistent_version = 2;
+		const std::size_t meta_dirty_offset = 2 * sizeof(unsigned);
+	}
+
+	void semidynamic_compact_index::write_meta(std::ostream &stream) const{
+		unsigned header = sizeof(size_type) | persistent_version << 16;
+		const unsigned padding = 0;
+		::sdci::detail::write_data(stream, &header);
+		::sdci::detail::write_data(stream, &padding);
+		write_flag(stream, false);
+		::sdci::detail::write_data(stream, &m_sigma);
+		::sdci::detail::write_data(stream, &m_param_q);
+		::sdci::detail::write_data(stream, &m_param_k);
+		::sdci::detail::write_data(stream, &m_textlen);
+		::sdci::detail::write_data(stream, &m_last_qgram);
+		::sdci::detail::write_data(stream, &m_next_sampling_pos);
+		write_flag(stream, m_first_appearance);
+		write_flag(stream, m_fast_count);
+		write_flag(stream, m_sparse_directory);
+		::sdci::detail::write_vector(stream, m_pow_sigma);
+
+		m_list_sampled.save_header(stream);
+		m_efirst.save_header(stream);
+		m_enext.save_header(stream);
+		m_encQ.save_header(stream);
+		if(m_fast_count){
+			m_qgram_count.save_header(stream);
+		}
+		if(m_sparse_directory){
+			m_sparse_qgrams.save_header(stream);
+		}
+	}
+
+	// Reads the parameters and returns whether the index was modified after the last sync.
+	bool semidynamic_compact_index::read_meta(std::istream &stream){
+		unsigned header = 0;
+		unsigned padding = 0;
+		::sdci::detail::read_data(stream, &header);
+		::sdci::detail::read_data(stream, &padding);
+		const unsigned version = header >> 16;
+		if((header & 0xFFFF) != sizeof(size_type) || version == 0 || version > persistent_version){
+			::sdci::detail::formaterr();
+		}
+		const bool dirty = read_flag(stream, format_version);
+		::sdci::detail::read_data(stream, &m_sigma);
+		::sdci::detail::read_data(stream, &m_param_q);
+		::sdci::detail::read_data(stream, &m_param_k);
+		::sdci::detail::read_data(stream, &m_textlen);
+		::sdci::detail::read_data(stream, &m_last_qgram);
+		::sdci::detail::read_data(stream, &m_next_sampling_pos);
+		m_first_appearance = read_flag(stream, format_version);
+		m_fast_count = read_flag(stream, format_version);
+		m_sparse_directory = version >= 2 && read_flag(stream, format_version);
+		::sdci::detail::read_vector(stream, m_pow_sigma);
+		set_encoding();
+		return dirty;
+	}
+
+	void semidynamic_compact_index::attach_files(const std::string &dirname){
+		m_list_sampled.attach_file(file_path(dirname, "list"));
+		m_efirst.attach_file(file_path(dirname, "efirst"));
+		m_enext.attach_file(file_path(dirname, "enext"));
+		m_encQ.attach_file(file_path(dirname, "encq"));
+		if(m_fast_count){
+			m_qgram_count.attach_file(file_path(dirname, "count"));
+		}
+		if(m_sparse_directory){
+			m_sparse_qgrams.attach_file(file_path(dirname, "sparse"));
+		}
+	}
+
+	void semidynamic_compact_index::persist(const char *dirname) try{
+		if(persistent()){
+			// the arrays leave the files of the previous directory
+			semidynamic_compact_index(*this).swap(*this);
+		}
+		if(m_mapped){
+			detach_arrays();
+		}
+		compact_directory(false);
+
+		std::vector<encode_type> text(m_textlen);
+		retrieve(text.begin());
+		::sdci::detail::packed_array text_log(text_log_width(m_sigma), m_textlen);
+		for(size_type i = 0; i < m_textlen; ++i){
+			text_log.set(i, text[i]);
+		}
+		std::vector<encode_type>().swap(text);
+
+		// the directory has no index until the files are synced
+		std::remove(file_path(dirname, "meta").c_str());
+		text_log.attach_file(file_path(dirname, "text"));
+		attach_files(dirname);
+
+		m_persistent.text.swap(text_log);
+		m_persistent.dirname = dirname;
+		m_persistent.dirty = true;
+		sync();
+	}
+	catch(...){
+		release_persistent();
+		throw;
+	}
+
+	void semidynamic_compact_index::open_persistent(const char *dirname_) try{
+		const std::string dirname(dirname_);
+		std::ifstream file(file_path(dirname, "meta").c_str(), std::ios_base::binary);
+		if(!file.good()){
+			::sdci::detail::ioerr();
+		}
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		const std::string meta = contents.str();
+
+		release_persistent();
+		if(m_mapped){
+			release_arrays();
+		}
+		// a persistent index has no compact directory
+		m_compact_directory = false;
+		::sdci::detail::packed_array().swap(m_qgram_ranks);
+		std::istringstream stream(meta);
+		const bool dirty = read_meta(stream);
+		m_persistent.text.open_file(file_path(dirname, "text"), text_log_width(m_sigma), m_textlen);
+		if(dirty){
+			recover(dirname);
+			return;
+		}
+
+		m_list_sampled.open_file(stream, file_path(dirname, "list"));
+		m_efirst.open_file(stream, file_path(dirname, "efirst"));
+		m_enext.open_file(stream, file_path(dirname, "enext"));
+		m_encQ.open_file(stream, file_path(dirname, "encq"));
+		if(m_fast_count){
+			m_qgram_count.open_file(stream, file_path(dirname, "count"));
+		}
+		else{
+			::sdci::detail::prefix_sum_array().swap(m_qgram_count);
+		}
+		if(m_sparse_directory){
+			m_sparse_qgrams.open_file(stream, file_path(dirname, "sparse"));
+		}
+		else{
+			::sdci::detail::sparse_qgram_map().swap(m_sparse_qgrams);
+		}
+		m_persistent.dirname = dirname;
+		m_persistent.meta = meta;
+		m_persistent.dirty = false;
+	}
+	catch(...){
+		release_persistent();
+		release_arrays();
+		m_fast_count = false;
+		m_sparse_directory = false;
+		initialize(0, 0, 0);
+		throw;
+	}
+
+	// Rebuilds the index from the text logged until the last sync.
+	void semidynamic_compact_index::recover(const std::string &dirname){
+		::sdci::detail::packed_array text_log;
+		text_log.swap(m_persistent.text);
+		const size_type textlen = m_textlen;
+		const size_type sigma = m_sigma;
+		const size_type param_q = m_param_q;
+		const size_type param_k = m_param_k;
+		const bool fast_count = m_fast_count;
+
+		release_arrays();
+		m_sigma = 0;
+		m_param_q = 0;
+		m_param_k = 0;
+		m_fast_count = false;
+		initialize(sigma, param_q, param_k);
+		enable_fast_count(fast_count);
+		reserve(textlen);
+
+		std::vector<encode_type> block;
+		for(size_type i = 0; i < textlen; i += block.size()){
+			block.resize(std::min<size_type>(textlen - i, 4096));
+			text_log.get_range(i, block.size(), block.data());
+			append(block.begin(), block.end());
+		}
+
+		attach_files(dirname);
+		m_persistent.text.swap(text_log);
+		m_persistent.dirname = dirname;
+		m_persistent.dirty = true;
+		sync();
+	}
+
+	void semidynamic_compact_index::sync(){
+		if(!persistent()){
+			return;
+		}
+		m_list_sampled.sync();
+		m_efirst.sync();
+		m_enext.sync();
+		m_encQ.sync();
+		if(m_fast_count){
+			m_qgram_count.sync();
+		}
+		if(m_sparse_directory){
+			m_sparse_qgrams.sync();
+		}
+		m_persistent.text.sync();
+
+		std::ostringstream stream;
+		write_meta(stream);
+		::sdci::detail::replace_file(file_path(m_persistent.dirname, "meta"), stream.str());
+		m_persistent.meta = stream.str();
+		m_persistent.dirty = false;
+	}
+
+	// The meta file records that the files have been modified after the last sync,
+	// before they are actually modified.
+	void semidynamic_compact_index::mark_dirty(){
+		if(m_persistent.dirty){
+			return;
+		}
+		std::string meta = m_persistent.meta;
+		const ::sdci::detail::uint64_type flag = 1;
+		meta.replace(meta_dirty_offset, sizeof(flag), reinterpret_cast<const char*>(&flag), sizeof(flag));
+		::sdci::detail::replace_file(file_path(m_persistent.dirname, "meta"), meta);
+		m_persistent.dirty = true;
+	}
+
+	void semidynamic_compact_index::reserve_text_log(size_type size_){
+		::sdci::detail::packed_array &text = m_persistent.text;
+		if(size_ > text.size()){
+			text.change_params(text.bit_width(), std::max(size_, text.size() * 2));
+		}
+	}
+
+	void semidynamic_compact_index::release_persistent(){
+		persistent_state().swap(m_persistent);
+	}
+}
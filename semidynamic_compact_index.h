@@ -36,12 +36,104 @@
 #include <cstring>
 #include <fstream>
 #include <limits>
+#include <functional>
 
 #include "integer_set.h"
 #include "sampled_position_list.h"
 #include "packed_array.h"
+#include "prefix_sum_array.h"
+#include "sparse_qgram_map.h"
+#include "mapped_file.h"
 
 namespace sdci{
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	class static_semidynamic_compact_index;
+
+	/*
+		A pattern whose positions match sets of characters,
+		e.g. IUPAC codes of DNA, case-folded letters, or don't-care positions.
+		It is passed to semidynamic_compact_index::locate() and count() instead of a sequence of characters.
+	*/
+	class class_pattern{
+	public:
+		typedef ::sdci::detail::size_type size_type;
+
+		class_pattern()
+		: m_offsets(1, 0)
+		{
+		}
+
+		/*
+			Appends a position which matches only ch.
+		*/
+		void push_back(size_type ch){
+			m_chars.push_back(ch);
+			m_offsets.push_back(m_chars.size());
+			m_any.push_back(false);
+		}
+
+		/*
+			Appends a position which matches the characters in [first, last).
+			It matches nothing if the range is empty.
+		*/
+		template <class InputIterator>
+		void push_back_class(InputIterator first, InputIterator last){
+			const size_type begin = m_chars.size();
+			for(; first != last; ++first){
+				m_chars.push_back(static_cast<size_type>(*first));
+			}
+			std::sort(m_chars.begin() + begin, m_chars.end());
+			m_chars.erase(std::unique(m_chars.begin() + begin, m_chars.end()), m_chars.end());
+			m_offsets.push_back(m_chars.size());
+			m_any.push_back(false);
+		}
+
+		/*
+			Appends a position which matches any character.
+		*/
+		void push_back_any(){
+			m_offsets.push_back(m_chars.size());
+			m_any.push_back(true);
+		}
+
+		size_type size() const{
+			return m_any.size();
+		}
+
+		bool empty() const{
+			return m_any.empty();
+		}
+
+		void clear(){
+			m_chars.clear();
+			m_offsets.assign(1, 0);
+			m_any.clear();
+		}
+
+		/*
+			Returns whether the i-th position matches any character.
+		*/
+		bool any(size_type i) const{
+			return m_any[i];
+		}
+
+		/*
+			The characters of the i-th position (unless any(i)) in ascending order without duplicates,
+			i.e. [chars_begin(i), chars_end(i)).
+		*/
+		const size_type* chars_begin(size_type i) const{
+			return m_chars.data() + m_offsets[i];
+		}
+
+		const size_type* chars_end(size_type i) const{
+			return m_chars.data() + m_offsets[i + 1];
+		}
+
+	private:
+		std::vector<size_type> m_chars;
+		std::vector<size_type> m_offsets;
+		std::vector<bool> m_any;
+	};
 
 	class semidynamic_compact_index{
 	public:
@@ -59,13 +151,14 @@ namespace sdci{
 			- sigma: The alphabet size.
 			- param_q: The parameter q.
 			- param_k: The parameter k.
+			- sparse_directory: Whether the sparse directory of q-grams is used (see enable_sparse_directory()).
 
 			Preconditions
 			- 1 <= param_k <= param_q
 			- (sigma^param_q * 8) must be representable in size_type.
 		*/
 		semidynamic_compact_index(
-			size_type sigma, size_type param_q, size_type param_k
+			size_type sigma, size_type param_q, size_type param_k, bool sparse_directory = false
 		);
 
 		/*
@@ -90,6 +183,131 @@ namespace sdci{
 
 		void reserve(size_type expected_max_text_length);
 
+		/*
+			Enables or disables the fast counting mode.
+			In this mode, the index also keeps the number of occurrences of each q-gram
+			with prefix sums over them,
+			so that count() does not need to locate the occurrences.
+
+			Parameter
+			- enable: Whether the mode is enabled.
+
+			Note
+			- The mode requires additional sigma^q log(n) bits,
+			  and append() takes additional O(q log sigma) time per character.
+			- If the text is not empty, enabling the mode takes O(n q log sigma) time and O(n) extra space.
+		*/
+		void enable_fast_count(bool enable = true);
+
+		/*
+			Returns whether the fast counting mode is enabled.
+		*/
+		bool fast_count_enabled() const;
+
+		/*
+			Enables or disables the incremental growth mode.
+			In this mode, the position lists are migrated to larger arrays
+			by a bounded number of entries in each append of a character,
+			instead of being copied at once when they are full,
+			so that the worst-case time of append() does not grow with n or sigma^q.
+
+			Parameter
+			- enable: Whether the mode is enabled.
+
+			Note
+			- Enabling the mode reserves sigma^q/16 sampled positions at least,
+			  and then each character appended migrates O(1) entries (128 at most in practice).
+			- The old and new lists coexist during a migration, which takes about a third of the appends.
+			- The mode is not saved. Loading an index disables it, and it is ignored for a persistent index.
+			- The prefix sums of the fast counting mode still grow at once; reserve() avoids it.
+		*/
+		void enable_incremental_growth(bool enable = true);
+
+		/*
+			Returns whether the incremental growth mode is enabled.
+		*/
+		bool incremental_growth_enabled() const;
+
+		/*
+			Enables or disables the rank directory of the q-grams.
+			The directory keeps the number of distinct q-grams in each block of 512 consecutive codes
+			with prefix sums over them, and append() updates it when a new q-gram appears.
+
+			Parameter
+			- enable: Whether the directory is kept.
+
+			Note
+			- The directory requires additional (sigma^q/512) log(sigma^q) bits,
+			  and enabling it takes O(sigma^q/64) time.
+			- With the directory, distinct_qgrams() takes O(log sigma^q) time,
+			  and locate_parallel() divides the q-grams of a pattern evenly among the threads.
+			- The directory is not saved. It is rebuilt when an index is loaded into this object while it is enabled.
+		*/
+		void enable_qgram_rank(bool enable = true);
+
+		/*
+			Returns whether the rank directory of the q-grams is kept.
+		*/
+		bool qgram_rank_enabled() const;
+
+		/*
+			Enables or disables the sparse directory of q-grams.
+			By default, the lists of the q-grams and the set of the q-grams of the text
+			have an entry for each of the sigma^q possible q-grams.
+			With the sparse directory, they have entries only for the q-grams which occur in the text,
+			found by a hash table and kept in ascending order for the queries,
+			so that the index can be used for sigma^q much larger than the memory
+			(e.g. a byte alphabet and q = 5).
+			The results of all operations are the same in both modes.
+
+			Parameter
+			- enable: Whether the sparse directory is used.
+
+			Note
+			- The sparse directory requires O(d log(sigma^q)) bits for d distinct q-grams.
+			  Each q-gram looked up in append() and locate() takes expected O(1) additional time,
+			  and a new q-gram takes O(sqrt(d)) amortized time.
+			- If the text is not empty, the index is rebuilt from the text, which takes O(n) extra space.
+			- The fast counting mode cannot be used with the sparse directory;
+			  if it is enabled, std::invalid_argument is thrown.
+		*/
+		void enable_sparse_directory(bool enable = true);
+
+		/*
+			Returns whether the sparse directory of q-grams is used.
+		*/
+		bool sparse_directory_enabled() const;
+
+		/*
+			Compacts the directory of q-grams, or expands it back.
+			The compact directory keeps the entries of the lists and the edges
+			only for the q-grams which occur in the text, in ascending order,
+			and finds the entry of a q-gram by its rank in the set of the q-grams,
+			from the ranks sampled at every 64 codes and a word of the set.
+			It is intended for an index which is queried rather than appended,
+			and is kept by save_file() and map_file().
+
+			Parameter
+			- compact: Whether the directory is compacted.
+
+			Note
+			- The lists and the edges take O(d log n) bits instead of O(sigma^q log n) bits for d distinct q-grams,
+			  and the ranks take (sigma^q/64) log d bits.
+			  The set of the q-grams still takes sigma^q bits.
+			- Each q-gram looked up in locate() takes O(1) additional time.
+			- Both directions take O(sigma^q) time and no extra space.
+			- append() expands the directory back when a q-gram which does not occur in the text appears,
+			  and clear() and initialize() also expand it.
+			- This function does nothing with the sparse directory or for a persistent index,
+			  and persist() expands the directory.
+		*/
+		void compact_directory(bool compact = true);
+
+		/*
+			Returns whether the directory of q-grams is compacted.
+		*/
+		bool directory_compacted() const;
+
 		/*
 			Assigns characters as the text.
 
@@ -105,6 +323,26 @@ namespace sdci{
 		template <class InputIterator>
 		void assign(InputIterator first, InputIterator last);
 
+		/*
+			Assigns characters as the text, building the index with multiple threads.
+
+			Parameters
+			- first, last: Random access iterators to the initial and final positions of the text. The range used is [first, last).
+			- num_threads: The number of threads. If it is 0, std::thread::hardware_concurrency() is used.
+
+			Precondition
+			- The values in [first, last) must be less than alphabet_size and must not be negative.
+
+			Note
+			- The text is split into chunks, which are indexed by separate threads
+			  and then merged, so that the index is identical to the one built by assign(first, last).
+			- Each thread uses sigma^q (log(n/k)+1) bits of working space.
+			- The occurrences for the fast counting mode are counted sequentially in the merge.
+			- If the text contains an invalid character, the text becomes empty and std::invalid_argument is thrown.
+		*/
+		template <class RandomAccessIterator>
+		void assign_parallel(RandomAccessIterator first, RandomAccessIterator last, unsigned num_threads = 0);
+
 		/*
 			Appends characters after the current text.
 
@@ -117,6 +355,46 @@ namespace sdci{
 		template <class InputIterator>
 		void append(InputIterator first, InputIterator last);
 
+		/*
+			The value of alphabet maps which means that the byte is skipped.
+		*/
+		static const size_type ignored_byte = size_type(-1);
+
+		/*
+			Appends the bytes of a file after the current text,
+			translating each byte into a character by an alphabet map.
+			The file is read in large blocks by a background thread,
+			while the previous block is appended.
+
+			Parameters
+			- filename: The name of the file.
+			- alphabet_map: alphabet_map[b] is the character of the byte b (as unsigned char).
+			  The bytes mapped to ignored_byte (e.g. line breaks) are skipped.
+
+			Preconditions
+			- alphabet_map.size() == 256
+			- The characters of the bytes in the file must be less than alphabet_size, unless they are ignored_byte.
+
+			Note
+			- The capacity for the size of the file is reserved in advance.
+			- If the file contains a byte of an invalid character,
+			  the bytes before it are appended and std::invalid_argument is thrown.
+		*/
+		void append_file(const char *filename, const std::vector<size_type> &alphabet_map);
+
+		/*
+			Appends the bytes read from a file descriptor until its end, in the same way as append_file().
+
+			Parameters
+			- fd: The file descriptor, which is read from its current offset and is not closed.
+			- alphabet_map: The same as append_file().
+
+			Note
+			- If fd refers to a regular file, the capacity for the rest of the file is reserved in advance.
+			- File descriptors are supported only where POSIX read() is available.
+		*/
+		void append_fd(int fd, const std::vector<size_type> &alphabet_map);
+
 		/*
 			Sets the length of text to 0.
 		*/
@@ -195,6 +473,80 @@ namespace sdci{
 			OutputIterator occ_result
 		) const;
 
+		/*
+			The distances of locate_approx().
+			- hamming_distance: The number of mismatched characters between the pattern and the text of the same length.
+			- edit_distance: The number of insertions, deletions and substitutions
+			  which turn the pattern into a text starting at the occurrence (of any length).
+		*/
+		enum distance_type{ hamming_distance, edit_distance };
+
+		/*
+			Computes all positions where given pattern occurs with at most max_distance errors.
+
+			Parameters
+			- pattern_first, pattern_last: Input iterators to the initial and final positions of given pattern. The range used is [pattern_first, pattern_last).
+			- max_distance: The maximum distance between the pattern and the text at an occurrence.
+			- distance: The distance (see distance_type).
+			- occ_result: Output iterator to the initial position of the range where the occurrences are stored.
+
+			Preconditions
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+			- For edit_distance, the length of pattern plus max_distance must not greater than max_pattern_length,
+			  unless max_distance is not less than the length of pattern (then every position is an occurrence).
+
+			Return Value
+			- Let r be the return value. Then the occurrences are writtern in range [occ_result, r), in any order.
+			  Each position is written once, however many texts starting there are within the distance.
+
+			Note
+			- The q-grams are enumerated character by character,
+			  and a prefix is pruned as soon as no q-gram of the text has it or its distance exceeds max_distance
+			  (for edit_distance, the distances to all prefixes of the pattern are kept as a column of the dynamic programming).
+			  The ranges of q-grams admitted are disjoint, and their occurrences are located in one traversal.
+		*/
+		template <class InputIterator, class OutputIterator>
+		OutputIterator locate_approx(
+			InputIterator pattern_first, InputIterator pattern_last,
+			size_type max_distance, distance_type distance,
+			OutputIterator occ_result
+		) const;
+
+		/*
+			Computes all occurrences of given pattern of character classes and writes to occ_result.
+
+			Parameters
+			- pattern: The pattern, each of whose positions matches a set of characters.
+			- occ_result: Output iterator to the initial position of the range where the occurrences are stored.
+
+			Preconditions
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Return Value
+			- Let r be the return value. Then the occurrences are writtern in range [occ_result, r), in any order.
+
+			Note
+			- The q-grams matching the pattern are enumerated once, position by position,
+			  by looking up the next q-gram for each character of a class, so that empty subranges are skipped;
+			  runs of single characters and the trailing don't-cares make one range at once.
+			  The occurrences of all the ranges are located in one traversal,
+			  instead of one locate() for each expansion of the pattern.
+		*/
+		template <class OutputIterator>
+		OutputIterator locate(const class_pattern &pattern, OutputIterator occ_result) const;
+
+		/*
+			Computes the number of all occurrences of given pattern of character classes.
+
+			Precondition
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Note
+			- In the fast counting mode (see enable_fast_count()),
+			  the occurrences of each range of q-grams are counted by the prefix sums without locating them.
+		*/
+		size_type count(const class_pattern &pattern) const;
+
 		/*
 			Computes the number of all occurrences of given pattern.
 
@@ -208,13 +560,121 @@ namespace sdci{
 			- The number of all occurrences of given pattern.
 
 			Note
-			- This function requires as the same time as locating.
+			- This function requires as the same time as locating,
+			  unless the fast counting mode is enabled (see enable_fast_count()).
+			  In that mode, it takes O(q log sigma) time.
 		*/
 		template <class InputIterator>
 		size_type count(
 			InputIterator pattern_first, InputIterator pattern_last
 		) const;
 
+		/*
+			Computes the number of distinct q-grams of the text which start with given pattern.
+
+			Parameters
+			- pattern_first, pattern_last: Input iterators to the initial and final positions of given pattern. The range used is [pattern_first, pattern_last).
+
+			Precondition
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Return Value
+			- The number of distinct q-grams with given pattern as prefix.
+			  It is 0 if the text is shorter than q.
+
+			Note
+			- The q-grams are enumerated unless the rank directory is kept (see enable_qgram_rank()).
+		*/
+		template <class InputIterator>
+		size_type distinct_qgrams(
+			InputIterator pattern_first, InputIterator pattern_last
+		) const;
+
+		class occurrence_cursor;
+
+		/*
+			Returns a cursor which enumerates the occurrences of given pattern on demand.
+
+			Parameters
+			- pattern_first, pattern_last: Input iterators to the initial and final positions of given pattern. The range used is [pattern_first, pattern_last).
+
+			Preconditions
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Return Value
+			- A cursor which yields the same occurrences as locate(), though the order may differ.
+
+			Note
+			- The cursor uses O(k) space regardless of the number of occurrences.
+			- The cursor is invalidated by any modification of the index.
+		*/
+		template <class InputIterator>
+		occurrence_cursor locate_cursor(
+			InputIterator pattern_first, InputIterator pattern_last
+		) const;
+
+		/*
+			Computes all occurrences of each of given patterns.
+
+			Parameters
+			- patterns_first, patterns_last: Input iterators to the initial and final positions of given patterns. The range used is [patterns_first, patterns_last). Each pattern is a container or an array of characters.
+			- results: results[i] is set to the occurrences of the i-th pattern (in any order).
+
+			Precondition
+			- The length of each pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Note
+			- The q-grams are scanned once in ascending order for all patterns,
+			  and the occurrences derived from a q-gram are computed once
+			  even if several patterns (e.g. identical patterns, or a pattern and its extensions) share it.
+		*/
+		template <class PatternIterator>
+		void locate_batch(
+			PatternIterator patterns_first, PatternIterator patterns_last,
+			std::vector<std::vector<size_type> > &results
+		) const;
+
+		/*
+			Computes all occurrences of given pattern with multiple threads.
+
+			Parameters
+			- pattern_first, pattern_last: Input iterators to the initial and final positions of given pattern. The range used is [pattern_first, pattern_last).
+			- result: The occurrences are appended to it (in any order).
+			- num_threads: The number of threads. If it is 0, std::thread::hardware_concurrency() is used.
+
+			Precondition
+			- The length of pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Note
+			- This function is effective for patterns with many occurrences such as short patterns.
+			  The q-grams with the pattern as prefix and the subtrees of occurrences derived from them
+			  are distributed to the threads by work stealing.
+		*/
+		template <class InputIterator>
+		void locate_parallel(
+			InputIterator pattern_first, InputIterator pattern_last,
+			std::vector<size_type> &result, unsigned num_threads = 0
+		) const;
+
+		/*
+			Computes the number of all occurrences of each of given patterns.
+
+			Parameters
+			- patterns_first, patterns_last: Input iterators to the initial and final positions of given patterns. The range used is [patterns_first, patterns_last). Each pattern is a container or an array of characters.
+			- results: results[i] is set to the number of occurrences of the i-th pattern.
+
+			Precondition
+			- The length of each pattern must not greater than max_pattern_length (i.e. q-k+1).
+
+			Note
+			- The q-grams are scanned in the same way as locate_batch().
+		*/
+		template <class PatternIterator>
+		void count_batch(
+			PatternIterator patterns_first, PatternIterator patterns_last,
+			std::vector<size_type> &results
+		) const;
+
 		/*
 			Retrieves the current text.
 
@@ -256,6 +716,74 @@ namespace sdci{
 		void load_file(const char *filename);
 		void load_stream(std::istream &stream);
 
+		/*
+			Maps a file saved by save_file() into memory, and makes this index a read-only view of it.
+			The arrays are not copied, so that queries can start immediately
+			and the pages are read on demand.
+
+			Parameters
+			- filename: The name of the file.
+			- options: The controls of read-ahead, prefaulting and locking of the pages.
+
+			Note
+			- The file must not be modified while it is mapped.
+			- A modifying function (e.g. append()) first copies the arrays into heap,
+			  except that clear() and initialize() just drop them.
+			- The files saved by older versions are loaded by load_file() instead.
+		*/
+		void map_file(const char *filename, const map_options &options = map_options());
+
+		/*
+			Returns whether this index is a view of a mapped file.
+		*/
+		bool mapped() const;
+
+		/*
+			Stores this index in a directory and keeps it there,
+			so that the index survives the end of the process and can be reopened by open_persistent().
+			Afterwards, the arrays are files mapped into memory and modified in place,
+			and the appended text is also logged to a file.
+
+			Parameter
+			- dirname: The name of the directory, which must exist. The files of a previous index in it are overwritten.
+
+			Note
+			- The modifications are made durable by sync().
+			  If the process ends without sync() (e.g. a crash or the destruction of this index),
+			  open_persistent() rolls the index back to the state at the last sync,
+			  by rebuilding the index from the logged text.
+			- clear() and initialize() are synced immediately.
+			- A copy of this index is not persistent.
+			- The text log takes n ceil(lg sigma) bits of the storage.
+			- This function takes O(n) time and extra space.
+		*/
+		void persist(const char *dirname);
+
+		/*
+			Opens the index stored in a directory by persist(), and makes this index persistent in it.
+
+			Parameter
+			- dirname: The name of the directory.
+
+			Note
+			- The arrays are mapped, not read, unless the index must be rolled back
+			  because it was modified after the last sync.
+			- Only one index may open a directory at a time.
+		*/
+		void open_persistent(const char *dirname);
+
+		/*
+			Writes the modifications of a persistent index to the storage,
+			and returns after they become durable.
+			If this index is not persistent, this function does nothing.
+		*/
+		void sync();
+
+		/*
+			Returns whether this index is stored in a directory by persist() or open_persistent().
+		*/
+		bool persistent() const;
+
 #if __cplusplus >= 201103L
 		semidynamic_compact_index(const semidynamic_compact_index &) = default;
 		semidynamic_compact_index(semidynamic_compact_index&&);
@@ -266,11 +794,15 @@ namespace sdci{
 
 
 	private:
+		template <std::size_t Sigma, std::size_t Q, std::size_t K>
+		friend class static_semidynamic_compact_index;
+
 		typedef ::sdci::detail::uint64_type encode_type;
 
 		encode_type lshift(encode_type, size_type) const;
 		encode_type rshift(encode_type, size_type) const;
 		encode_type mask(encode_type, size_type) const;
+		void set_encoding();
 
 		template <class InputIterator>
 		void reserve_if_able(InputIterator, InputIterator, std::input_iterator_tag);
@@ -278,8 +810,160 @@ namespace sdci{
 		template <class InputIterator>
 		void reserve_if_able(InputIterator first, InputIterator last, std::forward_iterator_tag);
 
+		enum{ append_block_size = 1 << 20 };
+
+		void append_blocks(::sdci::detail::block_reader &reader, const std::vector<size_type> &alphabet_map);
+
+		template <class InputIterator>
+		bool encode_pattern(InputIterator first, InputIterator last, encode_type &enc, size_type &len) const;
+
+		enum{ locate_batch_size = 256, prefetch_distance = 8 };
+
+		// the ranks of the q-grams are sampled at every compact_rank_interval codes in the compact directory
+		enum{ compact_rank_interval = 64 };
+
+		struct batch_pattern{
+			encode_type enc;
+			size_type len;
+			size_type range;
+		};
+
+		struct qgram_range{
+			encode_type first;
+			encode_type last;
+		};
+
+		template <class PatternIterator>
+		void encode_batch(
+			PatternIterator patterns_first, PatternIterator patterns_last,
+			std::vector<batch_pattern> &patterns
+		) const;
+
+		void make_batch_ranges(std::vector<batch_pattern> &patterns, std::vector<qgram_range> &ranges) const;
+
+		void sweep_batch(
+			const std::vector<qgram_range> &ranges,
+			std::vector<std::vector<size_type> > *occ_results, std::vector<size_type> *count_results
+		) const;
+
+		size_type count_encoded(encode_type ptn_enc, size_type ptn_len) const;
+		size_type distinct_qgrams_encoded(encode_type ptn_enc, size_type ptn_len) const;
+
+		void locate_parallel_encoded(
+			encode_type ptn_enc, size_type ptn_len, std::vector<size_type> &result, unsigned num_threads
+		) const;
+
+		void prefetch_qgram(encode_type qgram, bool with_edges) const;
+		void prefetch_slot(size_type slot, bool with_edges) const;
+
+		size_type qgram_slot(encode_type qgram) const;
+		size_type insert_qgram(encode_type qgram, bool &first_appearance);
+		void grow_qgram_slots();
+
+		// Enumerates the q-grams of the text in [first, last) in ascending order from either directory.
+		class qgram_iterator{
+		public:
+			qgram_iterator();
+			qgram_iterator(const semidynamic_compact_index &index, encode_type first, encode_type last);
+			bool next(size_type &qgram);
+
+		private:
+			bool m_sparse;
+			::sdci::detail::integer_set::range_iterator m_dense_qgrams;
+			::sdci::detail::sparse_qgram_map::range_iterator m_sparse_qgrams;
+		};
+
+		// the state of a thread in assign_parallel
+		struct build_chunk{
+			size_type begin;
+			size_type end;
+			::sdci::detail::integer_set seen;
+			::sdci::detail::packed_array heads;
+			std::vector<size_type> firsts;
+			std::vector<std::pair<encode_type, size_type> > stitches;
+		};
+
+		template <class RandomAccessIterator>
+		encode_type qgram_at(RandomAccessIterator text, size_type pos) const;
+
+		template <class RandomAccessIterator>
+		void build_chunk_lists(RandomAccessIterator text, size_type num_nodes, build_chunk &chunk);
+
+		template <class RandomAccessIterator>
+		void merge_chunks(RandomAccessIterator text, size_type text_length, std::vector<build_chunk> &chunks);
+
+		static unsigned hardware_threads();
+		static void run_parallel(size_type num_tasks, const std::function<void(size_type)> &task);
+
 		template <class OutputIterator>
-		OutputIterator locate_dfs(encode_type pattern, size_type offset, OutputIterator result) const;
+		OutputIterator locate_encoded(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const;
+
+		template <class OutputIterator>
+		OutputIterator locate_tail(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const;
+
+		template <class OutputIterator>
+		OutputIterator locate_frontier(
+			std::vector<encode_type> &frontier, size_type offset, OutputIterator result,
+			size_type stop_offset = size_type(-1)
+		) const;
+
+		// the state of locate_approx
+		struct approx_search{
+			std::vector<encode_type> pattern;	// sigma stands for the characters which the text cannot contain
+			size_type max_distance;
+			distance_type distance;
+			size_type max_depth;
+			bool empty_admitted;	// whether every text is within the distance
+			// the columns of the dynamic programming for the depths (pattern.size()+1 entries each),
+			// or the numbers of mismatches for hamming_distance
+			std::vector<size_type> columns;
+		};
+
+		enum approx_state{ approx_prune, approx_descend, approx_admit };
+
+		void start_approx_search(approx_search &search) const;
+		approx_state approx_step(approx_search &search, size_type depth, encode_type ch) const;
+		bool approx_prefix_matches(approx_search &search, encode_type str, size_type len) const;
+		void collect_approx_ranges(approx_search &search, std::vector<qgram_range> &ranges) const;
+		void collect_approx_ranges(
+			approx_search &search, encode_type prefix, size_type depth, std::vector<qgram_range> &ranges
+		) const;
+
+		bool class_matches(const class_pattern &pattern, encode_type str, size_type len) const;
+		void collect_class_ranges(
+			const class_pattern &pattern, encode_type prefix, size_type depth, std::vector<qgram_range> &ranges
+		) const;
+
+		template <class OutputIterator>
+		OutputIterator locate_ranges(const std::vector<qgram_range> &ranges, OutputIterator result) const;
+
+		template <class OutputIterator>
+		OutputIterator locate_tail_at(size_type i, OutputIterator result) const;
+
+		void make_writable();
+		void detach_arrays();
+		void release_arrays();
+
+		// the directory and the text log of a persistent index; a copy of it is empty
+		struct persistent_state{
+			persistent_state();
+			persistent_state(const persistent_state &other);
+			persistent_state& operator= (const persistent_state &other);
+			void swap(persistent_state &other);
+
+			std::string dirname;
+			std::string meta;	// the contents of the meta file written by the last sync
+			bool dirty;
+			::sdci::detail::packed_array text;
+		};
+
+		void mark_dirty();
+		void reserve_text_log(size_type size);
+		void attach_files(const std::string &dirname);
+		void write_meta(std::ostream &stream) const;
+		bool read_meta(std::istream &stream);
+		void recover(const std::string &dirname);
+		void release_persistent();
 
 		static size_type calc_node_width(size_type param_q, size_type param_k, size_type size);
 
@@ -293,11 +977,88 @@ namespace sdci{
 		encode_type m_last_qgram;
 		size_type m_next_sampling_pos;
 		bool m_first_appearance;
+		bool m_fast_count;
+		bool m_sparse_directory;
+		bool m_compact_directory;
+		bool m_mapped;
+		bool m_shift_encoding;
+		size_type m_lg_sigma;
 		std::vector<encode_type> m_pow_sigma;
 
 		::sdci::detail::sampled_position_list m_list_sampled;
 		::sdci::detail::packed_array m_efirst, m_enext;
 		::sdci::detail::integer_set m_encQ;
+		::sdci::detail::sparse_qgram_map m_sparse_qgrams;	// used instead of m_encQ with the sparse directory
+		::sdci::detail::packed_array m_qgram_ranks;	// the sampled ranks of the q-grams in the compact directory
+		::sdci::detail::prefix_sum_array m_qgram_count;
+		persistent_state m_persistent;
+	};
+
+	/*
+		A cursor over the occurrences of a pattern,
+		which keeps the state of the traversal of locate() explicitly.
+	*/
+	class semidynamic_compact_index::occurrence_cursor{
+	public:
+		typedef semidynamic_compact_index::size_type size_type;
+
+		/*
+			Constructs a cursor which yields nothing.
+		*/
+		occurrence_cursor();
+
+		/*
+			Returns true if all occurrences have been yielded.
+		*/
+		bool done() const;
+
+		/*
+			Yields the next occurrence.
+
+			Parameter
+			- pos: The occurrence is stored to it.
+
+			Return Value
+			- false if there are no more occurrences. In this case, pos is not changed.
+		*/
+		bool next(size_type &pos);
+
+		/*
+			Yields at most max_count occurrences.
+
+			Parameters
+			- result: Output iterator to the initial position of the range where the occurrences are stored.
+			- max_count: The maximum number of occurrences.
+
+			Return Value
+			- Let r be the return value. Then the occurrences are writtern in range [result, r).
+		*/
+		template <class OutputIterator>
+		OutputIterator fetch(OutputIterator result, size_type max_count);
+
+	private:
+		friend class semidynamic_compact_index;
+		typedef semidynamic_compact_index::encode_type encode_type;
+
+		enum phase_type{ phase_short_text, phase_qgrams, phase_tail, phase_done };
+
+		struct frame{
+			encode_type qgram;
+			size_type offset;
+			size_type node;
+			encode_type edge;
+		};
+
+		occurrence_cursor(const semidynamic_compact_index &index, encode_type pattern, size_type length);
+		void push(encode_type qgram, size_type offset);
+
+		const semidynamic_compact_index *m_index;
+		phase_type m_phase;
+		encode_type m_ptn_enc;
+		size_type m_ptn_len;
+		semidynamic_compact_index::qgram_iterator m_qgrams;
+		size_type m_tail_pos;
+		std::vector<frame> m_stack;
 	};
 }
 
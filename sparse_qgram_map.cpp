@@ -0,0 +1,264 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sparse_qgram_map.h"
+#include <algorithm>
+#include <cmath>
+
+namespace sdci{
+	namespace detail{
+		const sparse_qgram_map::size_type sparse_qgram_map::npos;
+
+		sparse_qgram_map::sparse_qgram_map(size_type new_limit)
+		: lim(0), cnt(0), merged(0)
+		{
+			initialize(new_limit);
+		}
+
+		void sparse_qgram_map::initialize(size_type new_limit){
+			release();
+			lim = new_limit;
+		}
+
+		void sparse_qgram_map::release(){
+			lim = 0;
+			cnt = 0;
+			merged = 0;
+			keys.clear();
+			table.clear();
+			sorted.clear();
+			recent.clear();
+		}
+
+		sparse_qgram_map::size_type
+		sparse_qgram_map::insert(key_type key, bool &inserted){
+			const size_type found = find(key);
+			if(found != npos){
+				inserted = false;
+				return found;
+			}
+			if(cnt == keys.size()){
+				reserve(std::max<size_type>(min_capacity, cnt * 2));
+			}
+
+			const size_type mask = table.size() - 1;
+			size_type b = bucket(key);
+			while(table.get(b) != 0){
+				b = (b + 1) & mask;
+			}
+			const size_type slot = cnt;
+			keys.set(slot, key);
+			table.set(b, slot + 1);
+
+			// the recent slots are kept sorted by insertion
+			const size_type num_recent = cnt - merged;
+			if(num_recent == recent.size()){
+				recent.change_params(recent.bit_width(), std::max<size_type>(min_recent, num_recent * 2));
+			}
+			const size_type pos = lower_bound(recent, num_recent, key);
+			for(size_type i = num_recent; i > pos; --i){
+				recent.set(i, recent.get(i - 1));
+			}
+			recent.set(pos, slot);
+			++cnt;
+			inserted = true;
+
+			const size_type recent_limit = std::max<size_type>(
+				min_recent, 4 * static_cast<size_type>(std::sqrt(static_cast<double>(merged)))
+			);
+			if(num_recent + 1 > recent_limit){
+				merge_recent();
+			}
+			return slot;
+		}
+
+		// The arrays of slots are widened for new_capacity slots, and the table is rebuilt.
+		void sparse_qgram_map::reserve(size_type new_capacity){
+			const size_type key_width = std::max(1, ::sdci::detail::ceillg64(lim));
+			const size_type slot_width = ::sdci::detail::ceillg64(new_capacity + 1);
+			keys.change_params(key_width, new_capacity);
+			if(slot_width != sorted.bit_width()){
+				sorted.change_params(slot_width, sorted.size());
+				recent.change_params(slot_width, recent.size());
+			}
+			// at most half of the buckets are used
+			table.change_params(slot_width, size_type(1) << ::sdci::detail::ceillg64(new_capacity * 2));
+			rehash();
+		}
+
+		void sparse_qgram_map::rehash(){
+			table.fill0();
+			const size_type mask = table.size() - 1;
+			for(size_type slot = 0; slot < cnt; ++slot){
+				size_type b = bucket(keys.get(slot));
+				while(table.get(b) != 0){
+					b = (b + 1) & mask;
+				}
+				table.set(b, slot + 1);
+			}
+		}
+
+		// Merges the recent slots into sorted from the back, so that no temporary array is needed.
+		void sparse_qgram_map::merge_recent(){
+			size_type i = merged;
+			size_type j = cnt - merged;
+			sorted.change_params(recent.bit_width(), cnt);
+			for(size_type out = cnt; j > 0; ){
+				const size_type r = recent.get(j - 1);
+				if(i > 0){
+					const size_type s = sorted.get(i - 1);
+					if(keys.get(s) > keys.get(r)){
+						sorted.set(--out, s);
+						--i;
+						continue;
+					}
+				}
+				sorted.set(--out, r);
+				--j;
+			}
+			merged = cnt;
+		}
+
+		// Returns the number of the first count slots in order whose elements are less than key.
+		sparse_qgram_map::size_type
+		sparse_qgram_map::lower_bound(const ::sdci::detail::packed_array &order, size_type count, key_type key) const{
+			size_type lo = 0;
+			while(count > 0){
+				const size_type half = count / 2;
+				if(keys.get(order.get(lo + half)) < key){
+					lo += half + 1;
+					count -= half + 1;
+				}
+				else{
+					count = half;
+				}
+			}
+			return lo;
+		}
+
+		sparse_qgram_map::size_type
+		sparse_qgram_map::rank(key_type key) const{
+			return lower_bound(sorted, merged, key) + lower_bound(recent, cnt - merged, key);
+		}
+
+		void sparse_qgram_map::clear(){
+			if(cnt != 0){
+				table.fill0();
+				cnt = 0;
+				merged = 0;
+			}
+		}
+
+		void sparse_qgram_map::save_stream(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &lim);
+			::sdci::detail::write_data(stream, &cnt);
+			::sdci::detail::write_data(stream, &merged);
+			keys.save_stream(stream);
+			table.save_stream(stream);
+			sorted.save_stream(stream);
+			recent.save_stream(stream);
+		}
+
+		void sparse_qgram_map::load_stream(std::istream &stream) try{
+			::sdci::detail::read_data(stream, &lim);
+			::sdci::detail::read_data(stream, &cnt);
+			::sdci::detail::read_data(stream, &merged);
+			keys.load_stream(stream);
+			table.load_stream(stream);
+			sorted.load_stream(stream);
+			recent.load_stream(stream);
+			if(cnt > keys.size() || merged > cnt || sorted.size() < merged || recent.size() < cnt - merged){
+				::sdci::detail::formaterr();
+			}
+		}
+		catch(...){
+			release();
+			throw;
+		}
+
+		void sparse_qgram_map::map_memory(::sdci::detail::mapped_reader &reader) try{
+			reader.read(&lim);
+			reader.read(&cnt);
+			reader.read(&merged);
+			keys.map_memory(reader);
+			table.map_memory(reader);
+			sorted.map_memory(reader);
+			recent.map_memory(reader);
+			if(cnt > keys.size() || merged > cnt || sorted.size() < merged || recent.size() < cnt - merged){
+				::sdci::detail::formaterr();
+			}
+		}
+		catch(...){
+			release();
+			throw;
+		}
+
+		// The arrays are kept in the files filename_prefix + ".keys", ".table", ".sorted" and ".recent".
+		void sparse_qgram_map::attach_file(const std::string &filename_prefix){
+			keys.attach_file(filename_prefix + ".keys");
+			table.attach_file(filename_prefix + ".table");
+			sorted.attach_file(filename_prefix + ".sorted");
+			recent.attach_file(filename_prefix + ".recent");
+		}
+
+		void sparse_qgram_map::save_header(std::ostream &stream) const{
+			::sdci::detail::write_data(stream, &lim);
+			::sdci::detail::write_data(stream, &cnt);
+			::sdci::detail::write_data(stream, &merged);
+			keys.save_header(stream);
+			table.save_header(stream);
+			sorted.save_header(stream);
+			recent.save_header(stream);
+		}
+
+		void sparse_qgram_map::open_file(std::istream &header, const std::string &filename_prefix) try{
+			::sdci::detail::read_data(header, &lim);
+			::sdci::detail::read_data(header, &cnt);
+			::sdci::detail::read_data(header, &merged);
+			keys.open_file(header, filename_prefix + ".keys");
+			table.open_file(header, filename_prefix + ".table");
+			sorted.open_file(header, filename_prefix + ".sorted");
+			recent.open_file(header, filename_prefix + ".recent");
+		}
+		catch(...){
+			release();
+			throw;
+		}
+
+		sparse_qgram_map::range_iterator::range_iterator()
+		: m_map(0), m_sorted(0), m_sorted_end(0), m_recent(0), m_recent_end(0)
+		{
+		}
+
+		sparse_qgram_map::range_iterator::range_iterator(const sparse_qgram_map &map, key_type first, key_type last)
+		: m_map(&map), m_sorted(0), m_sorted_end(0), m_recent(0), m_recent_end(0)
+		{
+			if(first >= last){
+				return;
+			}
+			const size_type num_recent = map.cnt - map.merged;
+			m_sorted = map.lower_bound(map.sorted, map.merged, first);
+			m_sorted_end = map.lower_bound(map.sorted, map.merged, last);
+			m_recent = map.lower_bound(map.recent, num_recent, first);
+			m_recent_end = map.lower_bound(map.recent, num_recent, last);
+		}
+	}
+}
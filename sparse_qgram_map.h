@@ -0,0 +1,253 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SDCI_SPARSE_QGRAM_MAP_H_INCLUDED
+#define SDCI_SPARSE_QGRAM_MAP_H_INCLUDED
+
+#include "sdci_common.h"
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include "packed_array.h"
+
+namespace sdci{
+	namespace detail{
+		/*
+			A set of integers in [0, limit()) which numbers its elements by slots 0, 1, 2, ...
+			in order of insertion, for a directory of q-grams whose space depends on
+			the number of q-grams which occur instead of the number of possible q-grams.
+			The slots are found by an open addressing hash table,
+			and the elements are also kept in ascending order for the range queries:
+			the older slots in a sorted array, and the recent ones in a small sorted buffer,
+			which is merged into the sorted array when it exceeds about 4 sqrt(size()) slots.
+		*/
+		class sparse_qgram_map{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+			typedef ::sdci::detail::uint64_type key_type;
+
+			static const size_type npos = size_type(-1);
+
+			explicit sparse_qgram_map(size_type new_limit = 0);
+			void initialize(size_type new_limit);
+
+			/*
+				Returns the slot of key, or npos if key is not an element.
+			*/
+			size_type find(key_type key) const;
+
+			/*
+				Inserts key and returns its slot.
+				inserted is set to whether key was not an element.
+			*/
+			size_type insert(key_type key, bool &inserted);
+
+			/*
+				Returns the element of given slot (slot < size()).
+			*/
+			key_type key(size_type slot) const;
+
+			/*
+				Returns the number of elements less than key.
+			*/
+			size_type rank(key_type key) const;
+
+			size_type limit() const;
+			size_type size() const;
+
+			/*
+				Returns the number of slots which can be used without reallocation.
+			*/
+			size_type capacity() const;
+			void clear();
+			void swap(sparse_qgram_map &other);
+			size_type heap_usage() const;
+			void save_stream(std::ostream &stream) const;
+			void load_stream(std::istream &stream);
+			void map_memory(::sdci::detail::mapped_reader &reader);
+			bool mapped() const;
+			void detach();
+			void attach_file(const std::string &filename_prefix);
+			void save_header(std::ostream &stream) const;
+			void open_file(std::istream &header, const std::string &filename_prefix);
+			void sync() const;
+
+			class range_iterator;
+
+#if __cplusplus >= 201103L
+			sparse_qgram_map(const sparse_qgram_map &) = default;
+			sparse_qgram_map(sparse_qgram_map &&) = default;
+			sparse_qgram_map& operator= (const sparse_qgram_map &) = default;
+			sparse_qgram_map& operator= (sparse_qgram_map &&) = default;
+			~sparse_qgram_map() = default;
+#endif
+
+		private:
+			enum{ min_capacity = 64, min_recent = 256 };
+
+			size_type lim;
+			size_type cnt;
+			size_type merged;	// the number of slots in sorted
+			::sdci::detail::packed_array keys;	// the element of each slot
+			::sdci::detail::packed_array table;	// slot + 1, or 0 for an empty bucket
+			::sdci::detail::packed_array sorted;	// the slots in [0, merged) in ascending order of their elements
+			::sdci::detail::packed_array recent;	// the slots in [merged, cnt) in ascending order of their elements
+
+			size_type bucket(key_type key) const;
+			size_type lower_bound(const ::sdci::detail::packed_array &order, size_type count, key_type key) const;
+			void reserve(size_type new_capacity);
+			void rehash();
+			void merge_recent();
+			void release();
+		};
+
+		/*
+			Enumerates the elements in [first, last) of a map in ascending order,
+			merging the sorted array and the buffer of the recent slots.
+			It is invalidated when the map is modified.
+		*/
+		class sparse_qgram_map::range_iterator{
+		public:
+			range_iterator();
+			range_iterator(const sparse_qgram_map &map, key_type first, key_type last);
+
+			/*
+				Sets key to the next element and returns true,
+				or returns false if no element remains.
+			*/
+			bool next(size_type &key);
+
+		private:
+			const sparse_qgram_map *m_map;
+			size_type m_sorted;
+			size_type m_sorted_end;
+			size_type m_recent;
+			size_type m_recent_end;
+		};
+
+		// inline functions
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::bucket(key_type key) const{
+			// Fibonacci hashing; the table has a power of two buckets
+			return (key * 0x9E3779B97F4A7C15ull) >> (64 - ::sdci::detail::smsb64(table.size()));
+		}
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::find(key_type key) const{
+			if(cnt == 0){
+				return npos;
+			}
+			const size_type mask = table.size() - 1;
+			for(size_type b = bucket(key); ; b = (b + 1) & mask){
+				const size_type entry = table.get(b);
+				if(entry == 0){
+					return npos;
+				}
+				if(keys.get(entry - 1) == key){
+					return entry - 1;
+				}
+			}
+		}
+
+		inline sparse_qgram_map::key_type
+		sparse_qgram_map::key(size_type slot) const{
+			return keys.get(slot);
+		}
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::limit() const{
+			return lim;
+		}
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::size() const{
+			return cnt;
+		}
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::capacity() const{
+			return keys.size();
+		}
+
+		inline void
+		sparse_qgram_map::swap(sparse_qgram_map &other){
+			std::swap(lim, other.lim);
+			std::swap(cnt, other.cnt);
+			std::swap(merged, other.merged);
+			keys.swap(other.keys);
+			table.swap(other.table);
+			sorted.swap(other.sorted);
+			recent.swap(other.recent);
+		}
+
+		inline bool
+		sparse_qgram_map::mapped() const{
+			return keys.mapped();
+		}
+
+		inline void
+		sparse_qgram_map::detach(){
+			keys.detach();
+			table.detach();
+			sorted.detach();
+			recent.detach();
+		}
+
+		inline void
+		sparse_qgram_map::sync() const{
+			keys.sync();
+			table.sync();
+			sorted.sync();
+			recent.sync();
+		}
+
+		inline sparse_qgram_map::size_type
+		sparse_qgram_map::heap_usage() const{
+			return keys.heap_usage() + table.heap_usage() + sorted.heap_usage() + recent.heap_usage();
+		}
+
+		inline bool
+		sparse_qgram_map::range_iterator::next(size_type &key){
+			if(m_sorted == m_sorted_end){
+				if(m_recent == m_recent_end){
+					return false;
+				}
+				key = m_map->keys.get(m_map->recent.get(m_recent++));
+				return true;
+			}
+			const key_type sorted_key = m_map->keys.get(m_map->sorted.get(m_sorted));
+			if(m_recent != m_recent_end){
+				const key_type recent_key = m_map->keys.get(m_map->recent.get(m_recent));
+				if(recent_key < sorted_key){
+					++m_recent;
+					key = recent_key;
+					return true;
+				}
+			}
+			++m_sorted;
+			key = sorted_key;
+			return true;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,590 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef SDCI_STATIC_SEMIDYNAMIC_COMPACT_INDEX_H_INCLUDED
+#define SDCI_STATIC_SEMIDYNAMIC_COMPACT_INDEX_H_INCLUDED
+
+#include "semidynamic_compact_index.h"
+#include <cstddef>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+namespace sdci{
+	/*
+		A semidynamic_compact_index whose parameters (sigma, q, k) are fixed at compile time.
+
+		The powers of sigma are constants, so that encoding and decoding q-grams
+		in append() and locate() compile to multiplications by constants (or shifts),
+		the edges are read and written with their bit width as a constant,
+		and the traversal of locate() is unrolled to depth k.
+		The index is stored in a semidynamic_compact_index, whose file format is shared,
+		and the other queries are made on dynamic_index().
+
+		Preconditions
+		- 1 <= K <= Q
+		- (Sigma^Q * 8) must be representable in size_type.
+	*/
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	class static_semidynamic_compact_index{
+	public:
+		typedef semidynamic_compact_index::size_type size_type;
+
+		static const size_type sigma = Sigma;
+		static const size_type param_q = Q;
+		static const size_type param_k = K;
+
+		/*
+			Creates index of empty text.
+		*/
+		static_semidynamic_compact_index();
+
+		/*
+			Creates index of the text of given index.
+
+			Note
+			- If the parameters of index differ from (Sigma, Q, K), std::invalid_argument is thrown.
+			- This index does not use the sparse or compact directory of q-grams,
+			  so that an index using the sparse one is rebuilt without it, and a compacted one is expanded.
+			  The same applies to loading and mapping.
+		*/
+		explicit static_semidynamic_compact_index(const semidynamic_compact_index &index);
+
+		void reserve(size_type expected_max_text_length);
+		void enable_fast_count(bool enable = true);
+		bool fast_count_enabled() const;
+		void enable_incremental_growth(bool enable = true);
+		bool incremental_growth_enabled() const;
+		void enable_qgram_rank(bool enable = true);
+		bool qgram_rank_enabled() const;
+
+		/*
+			The same as semidynamic_compact_index::assign().
+		*/
+		template <class InputIterator>
+		void assign(InputIterator first, InputIterator last);
+
+		/*
+			The same as semidynamic_compact_index::append().
+		*/
+		template <class InputIterator>
+		void append(InputIterator first, InputIterator last);
+
+		void clear();
+		void swap(static_semidynamic_compact_index &other);
+
+		size_type text_length() const;
+		size_type max_pattern_length() const;
+		size_type heap_usage() const;
+		size_type memory_usage() const;
+
+		/*
+			The same as semidynamic_compact_index::locate().
+		*/
+		template <class InputIterator, class OutputIterator>
+		OutputIterator locate(
+			InputIterator pattern_first, InputIterator pattern_last,
+			OutputIterator occ_result
+		) const;
+
+		/*
+			The same as semidynamic_compact_index::count().
+		*/
+		template <class InputIterator>
+		size_type count(InputIterator pattern_first, InputIterator pattern_last) const;
+
+		/*
+			The same as semidynamic_compact_index::distinct_qgrams().
+		*/
+		template <class InputIterator>
+		size_type distinct_qgrams(InputIterator pattern_first, InputIterator pattern_last) const;
+
+		template <class ForwardIterator>
+		ForwardIterator retrieve(ForwardIterator output_itr) const;
+
+		template <class ForwardIterator>
+		ForwardIterator extract(size_type from, size_type length, ForwardIterator output) const;
+
+		/*
+			The index is saved in the same format as semidynamic_compact_index.
+			Loading or mapping an index of other parameters throws std::runtime_error,
+			and leaves this index unchanged.
+		*/
+		void save_file(const char *filename) const;
+		void save_stream(std::ostream &stream) const;
+		void load_file(const char *filename);
+		void load_stream(std::istream &stream);
+		void map_file(const char *filename, const map_options &options = map_options());
+
+		/*
+			Returns the index with runtime parameters which stores this index,
+			for the other queries (e.g. locate_batch(), locate_cursor() and locate_parallel()).
+		*/
+		const semidynamic_compact_index& dynamic_index() const;
+
+	private:
+		typedef semidynamic_compact_index::encode_type encode_type;
+		typedef std::integral_constant<bool, true> more_levels;
+		typedef std::integral_constant<bool, false> no_more_levels;
+
+		static constexpr encode_type pow_sigma(size_type n){
+			return n == 0 ? 1 : Sigma * pow_sigma(n - 1);
+		}
+
+		static constexpr bool representable(size_type n){
+			return n == 0 || (representable(n - 1) && pow_sigma(n - 1) <= encode_type(-1) / Sigma);
+		}
+
+		static constexpr size_type ceillg(encode_type value){
+			return value <= 1 ? 0 : 1 + ceillg((value + 1) / 2);
+		}
+
+		// the width of the edges, which semidynamic_compact_index::initialize() sets to ceil(lg(sigma + 1))
+		static const size_type edge_width = ceillg(Sigma + 1);
+
+		static_assert(Sigma >= 1 && 1 <= K && K <= Q, "static_semidynamic_compact_index: invalid parameters");
+		static_assert(representable(Q) && pow_sigma(Q) <= encode_type(-1) / 8,
+			"static_semidynamic_compact_index: sigma^q is too large");
+
+		template <size_type N>
+		static encode_type lshift(encode_type value){
+			return value * std::integral_constant<encode_type, pow_sigma(N)>::value;
+		}
+
+		template <size_type N>
+		static encode_type rshift(encode_type value){
+			return value / std::integral_constant<encode_type, pow_sigma(N)>::value;
+		}
+
+		template <size_type N>
+		static encode_type mask(encode_type value){
+			return value % std::integral_constant<encode_type, pow_sigma(N)>::value;
+		}
+
+		template <class InputIterator>
+		bool encode_pattern(InputIterator first, InputIterator last, encode_type &enc, size_type &len) const;
+
+		template <class OutputIterator>
+		OutputIterator locate_encoded(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const;
+
+		template <size_type Offset, class OutputIterator>
+		OutputIterator locate_level(
+			std::vector<encode_type> &frontier, std::vector<encode_type> &next,
+			OutputIterator result, more_levels
+		) const;
+
+		template <size_type Offset, class OutputIterator>
+		OutputIterator locate_level(
+			std::vector<encode_type> &frontier, std::vector<encode_type> &next,
+			OutputIterator result, no_more_levels
+		) const;
+
+		void check_params(const semidynamic_compact_index &index) const;
+
+		semidynamic_compact_index m_index;
+	};
+
+	// implementation
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	const typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::sigma;
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	const typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::param_q;
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	const typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::param_k;
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	static_semidynamic_compact_index<Sigma, Q, K>::static_semidynamic_compact_index()
+	: m_index(Sigma, Q, K)
+	{
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	static_semidynamic_compact_index<Sigma, Q, K>::static_semidynamic_compact_index
+	(const semidynamic_compact_index &index)
+	: m_index(index)
+	{
+		if(index.alphabet_size() != Sigma || index.param_q() != Q || index.param_k() != K){
+			throw std::invalid_argument("static_semidynamic_compact_index");
+		}
+		m_index.enable_sparse_directory(false);
+		m_index.compact_directory(false);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::reserve(size_type expected_max_text_length){
+		m_index.reserve(expected_max_text_length);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::enable_fast_count(bool enable){
+		m_index.enable_fast_count(enable);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline bool
+	static_semidynamic_compact_index<Sigma, Q, K>::fast_count_enabled() const{
+		return m_index.fast_count_enabled();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::enable_incremental_growth(bool enable){
+		m_index.enable_incremental_growth(enable);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline bool
+	static_semidynamic_compact_index<Sigma, Q, K>::incremental_growth_enabled() const{
+		return m_index.incremental_growth_enabled();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::enable_qgram_rank(bool enable){
+		m_index.enable_qgram_rank(enable);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline bool
+	static_semidynamic_compact_index<Sigma, Q, K>::qgram_rank_enabled() const{
+		return m_index.qgram_rank_enabled();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator>
+	void static_semidynamic_compact_index<Sigma, Q, K>::assign(InputIterator first, InputIterator last){
+		clear();
+		append(first, last);
+	}
+
+	// The same as semidynamic_compact_index::append() with the parameters as constants.
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator>
+	void static_semidynamic_compact_index<Sigma, Q, K>::append(InputIterator first, InputIterator last){
+		if(first == last){
+			return;
+		}
+		semidynamic_compact_index &idx = m_index;
+		idx.make_writable();
+
+		typedef typename std::iterator_traits<InputIterator>::iterator_category category;
+		idx.reserve_if_able(first, last, category());
+
+		for(; first != last; ++first){
+			const encode_type next_ch = static_cast<encode_type>(*first);
+			if(next_ch >= Sigma){
+				idx.invalidarg(next_ch);
+			}
+			const encode_type next_qgram = lshift<1>(mask<Q - 1>(idx.m_last_qgram)) + next_ch;
+			++idx.m_textlen;
+
+			if(idx.m_textlen >= Q){
+				if(idx.m_textlen == idx.m_next_sampling_pos){
+					idx.m_list_sampled.insert_first(next_qgram);
+					idx.m_next_sampling_pos += K;
+				}
+
+				if(idx.m_first_appearance){
+					idx.m_enext.set_fixed<edge_width>(idx.m_last_qgram, idx.m_efirst.get_fixed<edge_width>(next_qgram));
+					idx.m_efirst.set_fixed<edge_width>(next_qgram, rshift<Q - 1>(idx.m_last_qgram) + 1);
+				}
+				idx.m_first_appearance = idx.m_encQ.insert(next_qgram);
+				if(idx.m_fast_count){
+					idx.m_qgram_count.increment(next_qgram);
+				}
+			}
+			idx.m_last_qgram = next_qgram;
+		}
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::clear(){
+		m_index.clear();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::swap(static_semidynamic_compact_index &other){
+		m_index.swap(other.m_index);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::text_length() const{
+		return m_index.text_length();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::max_pattern_length() const{
+		return Q - K + 1;
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::heap_usage() const{
+		return m_index.heap_usage();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::memory_usage() const{
+		return heap_usage() + sizeof(*this);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator, class OutputIterator>
+	OutputIterator static_semidynamic_compact_index<Sigma, Q, K>::locate
+	(InputIterator first, InputIterator last, OutputIterator result) const
+	{
+		if(first == last){
+			return result;
+		}
+
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return result;
+		}
+		return locate_encoded(ptn_enc, ptn_len, result);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator>
+	typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::count(InputIterator first, InputIterator last) const{
+		if(first == last){
+			return 0;
+		}
+
+		encode_type ptn_enc = 0;
+		size_type ptn_len = 0;
+		if(!encode_pattern(first, last, ptn_enc, ptn_len)){
+			return 0;
+		}
+		if(m_index.m_fast_count){
+			return m_index.count_encoded(ptn_enc, ptn_len);
+		}
+		return locate_encoded(ptn_enc, ptn_len, ::sdci::detail::count_iterator()).count();
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator>
+	inline typename static_semidynamic_compact_index<Sigma, Q, K>::size_type
+	static_semidynamic_compact_index<Sigma, Q, K>::distinct_qgrams(InputIterator first, InputIterator last) const{
+		return m_index.distinct_qgrams(first, last);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class ForwardIterator>
+	inline ForwardIterator
+	static_semidynamic_compact_index<Sigma, Q, K>::retrieve(ForwardIterator output) const{
+		return m_index.retrieve(output);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class ForwardIterator>
+	inline ForwardIterator
+	static_semidynamic_compact_index<Sigma, Q, K>::extract
+	(size_type from, size_type length, ForwardIterator output) const{
+		return m_index.extract(from, length, output);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::save_file(const char *filename) const{
+		m_index.save_file(filename);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline void
+	static_semidynamic_compact_index<Sigma, Q, K>::save_stream(std::ostream &stream) const{
+		m_index.save_stream(stream);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	void static_semidynamic_compact_index<Sigma, Q, K>::load_file(const char *filename){
+		semidynamic_compact_index loaded;
+		loaded.load_file(filename);
+		check_params(loaded);
+		loaded.enable_sparse_directory(false);
+		loaded.compact_directory(false);
+		m_index.swap(loaded);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	void static_semidynamic_compact_index<Sigma, Q, K>::load_stream(std::istream &stream){
+		semidynamic_compact_index loaded;
+		loaded.load_stream(stream);
+		check_params(loaded);
+		loaded.enable_sparse_directory(false);
+		loaded.compact_directory(false);
+		m_index.swap(loaded);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	void static_semidynamic_compact_index<Sigma, Q, K>::map_file(const char *filename, const map_options &options){
+		semidynamic_compact_index mapped;
+		mapped.map_file(filename, options);
+		check_params(mapped);
+		mapped.enable_sparse_directory(false);
+		mapped.compact_directory(false);
+		m_index.swap(mapped);
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	inline const semidynamic_compact_index&
+	static_semidynamic_compact_index<Sigma, Q, K>::dynamic_index() const{
+		return m_index;
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	void static_semidynamic_compact_index<Sigma, Q, K>::check_params(const semidynamic_compact_index &index) const{
+		if(index.alphabet_size() != Sigma || index.param_q() != Q || index.param_k() != K){
+			::sdci::detail::formaterr();
+		}
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class InputIterator>
+	bool static_semidynamic_compact_index<Sigma, Q, K>::encode_pattern
+	(InputIterator first, InputIterator last, encode_type &enc, size_type &len) const
+	{
+		enc = 0;
+		len = 0;
+		for(; first != last; ++first){
+			const encode_type next = static_cast<encode_type>(*first);
+			if(next >= Sigma){
+				return false;
+			}
+
+			enc = lshift<1>(enc) + next;
+			++len;
+			if(len > Q - K + 1){
+				m_index.ptnlenerr();
+			}
+		}
+		return true;
+	}
+
+	// The same as semidynamic_compact_index::locate_encoded(),
+	// except that the levels of the traversal are unrolled.
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <class OutputIterator>
+	OutputIterator static_semidynamic_compact_index<Sigma, Q, K>::locate_encoded
+	(encode_type ptn_enc, size_type ptn_len, OutputIterator result) const
+	{
+		const semidynamic_compact_index &idx = m_index;
+		if(idx.m_textlen < Q){
+			return idx.locate_encoded(ptn_enc, ptn_len, result);
+		}
+
+		const size_type difflen = Q - ptn_len;
+		const encode_type ptn_first = idx.lshift(ptn_enc, difflen);
+		const encode_type ptn_last = idx.lshift(ptn_enc + 1, difflen);
+
+		std::vector<encode_type> frontier;
+		std::vector<encode_type> next;
+		frontier.reserve(semidynamic_compact_index::locate_batch_size);
+		::sdci::detail::integer_set::range_iterator qgrams(idx.m_encQ, ptn_first, ptn_last);
+		for(size_type p = 0; qgrams.next(p); ){
+			frontier.push_back(p);
+			if(frontier.size() == semidynamic_compact_index::locate_batch_size){
+				result = locate_level<0>(frontier, next, result, more_levels());
+			}
+		}
+		result = locate_level<0>(frontier, next, result, more_levels());
+
+		return idx.locate_tail(ptn_enc, ptn_len, result);
+	}
+
+	// Outputs the occurrences of the level Offset (< K) and the following levels.
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <typename static_semidynamic_compact_index<Sigma, Q, K>::size_type Offset, class OutputIterator>
+	OutputIterator static_semidynamic_compact_index<Sigma, Q, K>::locate_level
+	(std::vector<encode_type> &frontier, std::vector<encode_type> &next, OutputIterator result, more_levels) const
+	{
+		typedef ::sdci::detail::sampled_position_list::value_type list_value_type;
+		enum{ prefetch_distance = semidynamic_compact_index::prefetch_distance };
+		const bool expand = Offset + 1 < K;
+		const semidynamic_compact_index &idx = m_index;
+
+		const size_type num = frontier.size();
+		if(num == 0){
+			return result;
+		}
+		for(size_type i = 0; i < num && i < prefetch_distance; ++i){
+			idx.prefetch_qgram(frontier[i], expand);
+		}
+
+		for(size_type i = 0; i < num; ++i){
+			if(i + prefetch_distance < num){
+				idx.prefetch_qgram(frontier[i + prefetch_distance], expand);
+			}
+
+			const encode_type ptn = frontier[i];
+			for(list_value_type nd = idx.m_list_sampled.first_node(ptn);
+				nd != ::sdci::detail::sampled_position_list::npos;
+				nd = idx.m_list_sampled.next_node(nd)
+			){
+				*result = nd * K + Offset;
+				++result;
+			}
+
+			if(expand){
+				encode_type eattr = idx.m_efirst.get_fixed<edge_width>(ptn);
+				const encode_type rsptn = rshift<1>(ptn);
+				while(eattr != 0){
+					const encode_type nextptn = rsptn + lshift<Q - 1>(eattr - 1);
+					next.push_back(nextptn);
+					eattr = idx.m_enext.get_fixed<edge_width>(nextptn);
+				}
+			}
+		}
+
+		frontier.swap(next);
+		next.clear();
+		return locate_level<Offset + 1>(frontier, next, result, std::integral_constant<bool, (Offset + 1 < K)>());
+	}
+
+	template <std::size_t Sigma, std::size_t Q, std::size_t K>
+	template <typename static_semidynamic_compact_index<Sigma, Q, K>::size_type Offset, class OutputIterator>
+	inline OutputIterator static_semidynamic_compact_index<Sigma, Q, K>::locate_level
+	(std::vector<encode_type> &frontier, std::vector<encode_type> &, OutputIterator result, no_more_levels) const
+	{
+		frontier.clear();
+		return result;
+	}
+}
+
+#endif
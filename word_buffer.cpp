@@ -0,0 +1,241 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "word_buffer.h"
+#include <algorithm>
+
+namespace sdci{
+	namespace detail{
+		word_buffer::word_buffer(size_type size_)
+		: m_vec(size_)
+		{
+			sync_vector();
+		}
+
+		word_buffer::word_buffer(const word_buffer &other)
+		: m_owner(other.m_owner)
+		{
+			if(m_owner){
+				m_data = other.m_data;
+				m_size = other.m_size;
+			}
+			else{
+				m_vec.assign(other.m_data, other.m_data + other.m_size);
+				sync_vector();
+			}
+		}
+
+		word_buffer& word_buffer::operator= (const word_buffer &other){
+			if(this != &other){
+				word_buffer(other).swap(*this);
+			}
+			return *this;
+		}
+
+#if __cplusplus >= 201103L
+		word_buffer::word_buffer(word_buffer &&other)
+		: m_data(0), m_size(0)
+		{
+			this->swap(other);
+		}
+
+		word_buffer& word_buffer::operator= (word_buffer &&other){
+			this->swap(other);
+			return *this;
+		}
+#endif
+
+		void word_buffer::sync_vector(){
+			m_data = m_vec.empty() ? 0 : &m_vec[0];
+			m_size = m_vec.size();
+		}
+
+		void word_buffer::resize(size_type size_){
+			if(m_file){
+				m_file->resize(size_ * sizeof(value_type));
+				m_data = reinterpret_cast<value_type*>(m_file->data());
+				m_size = size_;
+			}
+			else if(m_owner){
+				vector_type vec(size_);
+				std::copy(m_data, m_data + std::min(size_, m_size), vec.begin());
+				m_vec.swap(vec);
+				m_owner.reset();
+				sync_vector();
+			}
+			else{
+				// the reused capacity is not zeroed by the allocator
+				const size_type old_size = m_vec.size();
+				const bool reuse = size_ > old_size && size_ <= m_vec.capacity();
+				m_vec.resize(size_);
+				if(reuse){
+					std::fill(m_vec.begin() + old_size, m_vec.end(), value_type());
+				}
+				sync_vector();
+			}
+		}
+
+		void word_buffer::fill(value_type value){
+			if(m_owner){
+				m_vec.assign(m_size, value);
+				m_owner.reset();
+				sync_vector();
+			}
+			else{
+				std::fill(m_data, m_data + m_size, value);
+			}
+		}
+
+		void word_buffer::clear(){
+			if(m_file){
+				resize(0);
+				return;
+			}
+			vector_type().swap(m_vec);
+			m_owner.reset();
+			sync_vector();
+		}
+
+		void word_buffer::shrink_to_fit(){
+			if(!m_owner && !m_file && m_vec.size() != m_vec.capacity()){
+				vector_type(m_vec).swap(m_vec);
+				sync_vector();
+			}
+		}
+
+		void word_buffer::swap(word_buffer &other){
+			m_vec.swap(other.m_vec);
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+			m_owner.swap(other.m_owner);
+			m_file.swap(other.m_file);
+		}
+
+		void word_buffer::view(const value_type *data_, size_type size_, const std::shared_ptr<const void> &owner){
+			vector_type().swap(m_vec);
+			m_file.reset();
+			m_data = const_cast<value_type*>(data_);
+			m_size = size_;
+			m_owner = owner;
+		}
+
+		void word_buffer::detach(){
+			if(m_owner){
+				m_vec.assign(m_data, m_data + m_size);
+				m_owner.reset();
+				sync_vector();
+			}
+		}
+
+		void word_buffer::replace(word_buffer &other){
+			if(m_file){
+				resize(other.size());
+				std::copy(other.m_data, other.m_data + other.m_size, m_data);
+			}
+			else{
+				swap(other);
+			}
+		}
+
+		void word_buffer::attach_file(const std::string &filename){
+			std::unique_ptr<file_mapping> file(new file_mapping(filename, true));
+			file->resize(m_size * sizeof(value_type));
+			value_type *data_ = reinterpret_cast<value_type*>(file->data());
+			std::copy(m_data, m_data + m_size, data_);
+
+			vector_type().swap(m_vec);
+			m_owner.reset();
+			m_file.swap(file);
+			m_data = data_;
+		}
+
+		void word_buffer::open_file(const std::string &filename, size_type size_){
+			std::unique_ptr<file_mapping> file(new file_mapping(filename, false));
+			if(file->size() < size_ * sizeof(value_type)){
+				::sdci::detail::formaterr();
+			}
+			if(file->size() > size_ * sizeof(value_type)){
+				file->resize(size_ * sizeof(value_type));
+			}
+
+			vector_type().swap(m_vec);
+			m_owner.reset();
+			m_file.swap(file);
+			m_data = reinterpret_cast<value_type*>(m_file->data());
+			m_size = size_;
+		}
+
+		void word_buffer::sync() const{
+			if(m_file){
+				m_file->sync();
+			}
+		}
+
+		// The same format as write_vector.
+		void word_buffer::save_stream(std::ostream &stream, size_type num_elements) const{
+			num_elements = std::min(num_elements, m_size);
+			::sdci::detail::write_data(stream, &num_elements);
+			if(num_elements != 0){
+				::sdci::detail::write_data(stream, m_data, num_elements * sizeof(value_type));
+			}
+		}
+
+		void word_buffer::load_stream(std::istream &stream){
+			m_owner.reset();
+			m_file.reset();
+			try{
+				::sdci::detail::read_vector(stream, m_vec);
+			}
+			catch(...){
+				sync_vector();
+				throw;
+			}
+			sync_vector();
+		}
+
+		mapped_reader::mapped_reader(const char *first, const char *last, const std::shared_ptr<const void> &owner)
+		: m_cur(first), m_last(last), m_owner(owner)
+		{
+		}
+
+		const char* mapped_reader::advance(size_type bytes){
+			if(bytes > size_type(m_last - m_cur)){
+				::sdci::detail::formaterr();
+			}
+			const char *ret = m_cur;
+			m_cur += bytes;
+			return ret;
+		}
+
+		void mapped_reader::read_words(word_buffer &buf){
+			typedef word_buffer::value_type value_type;
+			size_type size = 0;
+			read(&size);
+			if(reinterpret_cast<std::size_t>(m_cur) % sizeof(value_type) != 0 ||
+				size > size_type(m_last - m_cur) / sizeof(value_type)
+			){
+				::sdci::detail::formaterr();
+			}
+			buf.view(reinterpret_cast<const value_type*>(advance(size * sizeof(value_type))), size, m_owner);
+		}
+	}
+}
@@ -0,0 +1,261 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SDCI_WORD_BUFFER_H_INCLUDED
+#define SDCI_WORD_BUFFER_H_INCLUDED
+
+#include "sdci_common.h"
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <memory>
+#include <string>
+#include <utility>
+#include <iostream>
+#include "mapped_file.h"
+
+namespace sdci{
+	namespace detail{
+		/*
+			An allocator of zero-filled memory (see allocate_zeroed).
+			Value-initialization does not write the elements again,
+			so large arrays are allocated in a time independent of their sizes.
+		*/
+		template <class Tp>
+		class zeroed_allocator{
+		public:
+			typedef Tp value_type;
+
+			zeroed_allocator(){}
+			template <class Up>
+			zeroed_allocator(const zeroed_allocator<Up> &){}
+
+			Tp* allocate(std::size_t n){
+				if(n > std::size_t(-1) / sizeof(Tp)){
+					throw std::bad_alloc();
+				}
+				return static_cast<Tp*>(::sdci::detail::allocate_zeroed(n * sizeof(Tp)));
+			}
+
+			void deallocate(Tp *p, std::size_t n){
+				::sdci::detail::deallocate_zeroed(p, n * sizeof(Tp));
+			}
+
+			template <class Up>
+			void construct(Up *){
+			}
+
+			template <class Up, class... Args>
+			void construct(Up *p, Args&&... args){
+				::new(static_cast<void*>(p)) Up(std::forward<Args>(args)...);
+			}
+		};
+
+		template <class Tp, class Up>
+		inline bool operator== (const zeroed_allocator<Tp> &, const zeroed_allocator<Up> &){
+			return true;
+		}
+
+		template <class Tp, class Up>
+		inline bool operator!= (const zeroed_allocator<Tp> &, const zeroed_allocator<Up> &){
+			return false;
+		}
+
+		/*
+			An array of 64-bit words,
+			which either owns its words, is a read-only view of words owned by others
+			(e.g. a memory-mapped file), or is stored in a file mapped writably.
+			The functions which modify the size or all of the words turn a view into an owned array,
+			but the elements of a view must not be modified through operator[] and data().
+			A copy of a view is a view, and a copy of a file-backed array owns its words.
+		*/
+		class word_buffer{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+			typedef ::sdci::detail::uint64_type value_type;
+
+			explicit word_buffer(size_type size = 0);
+			word_buffer(const word_buffer &other);
+			word_buffer& operator= (const word_buffer &other);
+
+#if __cplusplus >= 201103L
+			word_buffer(word_buffer &&other);
+			word_buffer& operator= (word_buffer &&other);
+			~word_buffer() = default;
+#endif
+
+			size_type size() const;
+			size_type capacity() const;
+			bool is_view() const;
+			const value_type* data() const;
+			value_type* data();
+			value_type operator[] (size_type pos) const;
+			value_type& operator[] (size_type pos);
+
+			void resize(size_type size);
+			void fill(value_type value);
+			void clear();
+			void shrink_to_fit();
+			void swap(word_buffer &other);
+
+			/*
+				Makes this a view of [data, data+size).
+				The words are kept valid by holding owner.
+			*/
+			void view(const value_type *data, size_type size, const std::shared_ptr<const void> &owner);
+
+			/*
+				Turns a view into an owned array by copying the words.
+			*/
+			void detach();
+
+			/*
+				Takes the words of other (which is left unspecified).
+				A file-backed array copies them into its file instead of taking the storage of other.
+			*/
+			void replace(word_buffer &other);
+
+			/*
+				Moves the words into the file, which is created or truncated,
+				and keeps them there afterwards.
+			*/
+			void attach_file(const std::string &filename);
+
+			/*
+				Makes this an array of the first size words stored in the file,
+				and cuts off the rest of the file.
+			*/
+			void open_file(const std::string &filename, size_type size);
+
+			bool is_file_backed() const;
+
+			/*
+				Waits until the words are written to the file.
+			*/
+			void sync() const;
+
+			void save_stream(std::ostream &stream, size_type num_elements = size_type(-1)) const;
+			void load_stream(std::istream &stream);
+
+		private:
+			typedef std::vector<value_type, ::sdci::detail::zeroed_allocator<value_type> > vector_type;
+
+			void sync_vector();
+
+			vector_type m_vec;
+			value_type *m_data;
+			size_type m_size;
+			std::shared_ptr<const void> m_owner;
+			std::unique_ptr<file_mapping> m_file;
+		};
+
+		/*
+			Reads the data saved by save_stream from a region of memory, such as a mapped file.
+			The arrays of words are not copied but viewed,
+			so they must be aligned to 8 bytes in the region.
+		*/
+		class mapped_reader{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+
+			mapped_reader(const char *first, const char *last, const std::shared_ptr<const void> &owner);
+
+			template <class Tp>
+			void read(Tp *value);
+
+			template <class Tp>
+			void read_vector(std::vector<Tp> &vec);
+
+			void read_words(word_buffer &buf);
+
+		private:
+			const char* advance(size_type bytes);
+
+			const char *m_cur;
+			const char *m_last;
+			std::shared_ptr<const void> m_owner;
+		};
+
+		// inline functions
+
+		inline word_buffer::size_type
+		word_buffer::size() const{
+			return m_size;
+		}
+
+		inline word_buffer::size_type
+		word_buffer::capacity() const{
+			return m_vec.capacity();
+		}
+
+		inline bool
+		word_buffer::is_view() const{
+			return static_cast<bool>(m_owner);
+		}
+
+		inline const word_buffer::value_type*
+		word_buffer::data() const{
+			return m_data;
+		}
+
+		inline word_buffer::value_type*
+		word_buffer::data(){
+			return m_data;
+		}
+
+		inline word_buffer::value_type
+		word_buffer::operator[] (size_type pos) const{
+			return m_data[pos];
+		}
+
+		inline word_buffer::value_type&
+		word_buffer::operator[] (size_type pos){
+			return m_data[pos];
+		}
+
+		inline bool
+		word_buffer::is_file_backed() const{
+			return static_cast<bool>(m_file);
+		}
+
+		template <class Tp>
+		inline void mapped_reader::read(Tp *value){
+			std::memcpy(value, advance(sizeof(Tp)), sizeof(Tp));
+		}
+
+		template <class Tp>
+		inline void mapped_reader::read_vector(std::vector<Tp> &vec){
+			size_type size = 0;
+			read(&size);
+			if(size > size_type(m_last - m_cur) / sizeof(Tp)){
+				::sdci::detail::formaterr();
+			}
+			vec.resize(size);
+			if(size != 0){
+				std::memcpy(&vec[0], advance(size * sizeof(Tp)), size * sizeof(Tp));
+			}
+		}
+	}
+}
+
+#endif
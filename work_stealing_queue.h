@@ -0,0 +1,164 @@
+/*
+    Copyright (C) 2015, Yoshiaki Matsuoka
+
+
+    This file is part of semidynamic-compact-index.
+
+    semidynamic-compact-index is free software: you can redistribute it and/or 
+    modify it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    semidynamic-compact-index is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with semidynamic-compact-index. 
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SDCI_WORK_STEALING_QUEUE_H_INCLUDED
+#define SDCI_WORK_STEALING_QUEUE_H_INCLUDED
+
+#include "sdci_common.h"
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+namespace sdci{
+	namespace detail{
+		/*
+			Deques of tasks for each thread.
+			A thread takes tasks from the back of its own deque,
+			and steals tasks from the front of the others when its own is empty,
+			trying the threads id + 1, id + 2, ... in turn.
+			The tasks which are pushed but not yet done are counted,
+			so that the threads can know when all tasks are done
+			even if a task pushes new tasks.
+		*/
+		template <class Task>
+		class work_stealing_queue{
+		public:
+			typedef ::sdci::detail::size_type size_type;
+
+			explicit work_stealing_queue(size_type num_threads);
+
+			size_type thread_count() const;
+
+			/*
+				Pushes a task to the back of the deque of thread id.
+			*/
+			void push(size_type id, const Task &task);
+
+			/*
+				Takes a task for thread id, and increments steals if it is taken from another thread.
+				Returns false if all the deques are empty.
+				The task must be reported by done() when it is finished.
+			*/
+			bool pop(size_type id, Task &task, size_type &steals);
+			bool pop(size_type id, Task &task);
+
+			void done();
+
+			/*
+				Returns true if all the tasks pushed are done.
+			*/
+			bool finished() const;
+
+			/*
+				Removes all the tasks. No thread may use the queue meanwhile.
+			*/
+			void clear();
+
+#if __cplusplus >= 201103L
+			work_stealing_queue(const work_stealing_queue &) = delete;
+			work_stealing_queue& operator= (const work_stealing_queue &) = delete;
+#endif
+
+		private:
+			struct deque_type{
+				std::mutex mtx;
+				std::deque<Task> tasks;
+			};
+
+			std::vector<deque_type> m_deques;
+			std::atomic<size_type> m_pending;
+		};
+
+		template <class Task>
+		work_stealing_queue<Task>::work_stealing_queue(size_type num_threads)
+		: m_deques(num_threads), m_pending(0)
+		{
+		}
+
+		template <class Task>
+		inline typename work_stealing_queue<Task>::size_type
+		work_stealing_queue<Task>::thread_count() const{
+			return m_deques.size();
+		}
+
+		template <class Task>
+		void work_stealing_queue<Task>::push(size_type id, const Task &task){
+			m_pending.fetch_add(1);
+			deque_type &own = m_deques[id];
+			std::lock_guard<std::mutex> lock(own.mtx);
+			own.tasks.push_back(task);
+		}
+
+		template <class Task>
+		bool work_stealing_queue<Task>::pop(size_type id, Task &task, size_type &steals){
+			{
+				deque_type &own = m_deques[id];
+				std::lock_guard<std::mutex> lock(own.mtx);
+				if(!own.tasks.empty()){
+					task = own.tasks.back();
+					own.tasks.pop_back();
+					return true;
+				}
+			}
+			const size_type num_threads = m_deques.size();
+			for(size_type i = 1; i < num_threads; ++i){
+				deque_type &victim = m_deques[(id + i) % num_threads];
+				std::lock_guard<std::mutex> lock(victim.mtx);
+				if(!victim.tasks.empty()){
+					task = victim.tasks.front();
+					victim.tasks.pop_front();
+					++steals;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		template <class Task>
+		inline bool work_stealing_queue<Task>::pop(size_type id, Task &task){
+			size_type steals = 0;
+			return pop(id, task, steals);
+		}
+
+		template <class Task>
+		inline void work_stealing_queue<Task>::done(){
+			m_pending.fetch_sub(1);
+		}
+
+		template <class Task>
+		inline bool work_stealing_queue<Task>::finished() const{
+			return m_pending.load() == 0;
+		}
+
+		template <class Task>
+		void work_stealing_queue<Task>::clear(){
+			for(size_type i = 0; i < m_deques.size(); ++i){
+				m_deques[i].tasks.clear();
+			}
+			m_pending.store(0);
+		}
+	}
+}
+
+#endif